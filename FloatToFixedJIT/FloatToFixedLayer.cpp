@@ -0,0 +1,165 @@
+#include <string>
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Module.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/IndirectionUtils.h"
+#include "FloatToFixedLayer.h"
+
+using namespace llvm;
+using namespace llvm::orc;
+using namespace flttofix;
+
+
+FloatToFixedLayer::FloatToFixedLayer(ExecutionSession& es, IRLayer& baseLayer,
+  const FloatToFixedOptions& options, TargetIRAnalysis tira):
+  IRLayer(es), baseLayer(baseLayer), converter(options, std::move(tira))
+{
+}
+
+
+/* Returns if v is used by a definition which is not in defs */
+static bool isUsedOutside(Value *v, const SmallPtrSetImpl<GlobalValue *>& defs)
+{
+  for (User *u: v->users()) {
+    if (Instruction *i = dyn_cast<Instruction>(u)) {
+      if (!defs.count(i->getFunction()))
+        return true;
+    } else if (GlobalValue *gv = dyn_cast<GlobalValue>(u)) {
+      if (!defs.count(gv))
+        return true;
+    } else if (isa<Constant>(u) && isUsedOutside(u, defs)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+
+/* Turns a definition moved to another module into a declaration */
+static void makeDeclaration(GlobalValue& gv)
+{
+  if (Function *f = dyn_cast<Function>(&gv)) {
+    f->deleteBody();
+    f->setPersonalityFn(nullptr);
+  } else if (GlobalVariable *var = dyn_cast<GlobalVariable>(&gv)) {
+    var->setInitializer(nullptr);
+  } else if (GlobalAlias *alias = dyn_cast<GlobalAlias>(&gv)) {
+    /* aliases cannot be declarations, so they are replaced by a declaration
+     * of the same kind of their aliasee */
+    std::string name = alias->getName();
+    GlobalValue *decl;
+    if (Function *f = dyn_cast<Function>(alias->getBaseObject()))
+      decl = cloneFunctionDecl(*alias->getParent(), *f);
+    else
+      decl = cloneGlobalVariableDecl(*alias->getParent(), *cast<GlobalVariable>(alias->getBaseObject()));
+    alias->replaceAllUsesWith(ConstantExpr::getBitCast(decl, alias->getType()));
+    alias->eraseFromParent();
+    decl->setName(name);
+    return;
+  }
+  gv.setLinkage(GlobalValue::ExternalLinkage);
+}
+
+
+void FloatToFixedLayer::emit(MaterializationResponsibility r, ThreadSafeModule tsm)
+{
+  ThreadSafeModule part;
+  bool hasRemainder = false;
+  {
+    ThreadSafeContext::Lock lock = tsm.getContext().getLock();
+    Module& m = *tsm.getModule();
+    MangleAndInterner mangle(getExecutionSession(), m.getDataLayout());
+
+    /* the requested definitions and the ones which must be converted with
+     * them; the conversion of the others waits until they are looked up */
+    SymbolNameSet requested = r.getRequestedSymbols();
+    SmallPtrSet<GlobalValue *, 16> defs;
+    unsigned numDefs = 0;
+    for (GlobalValue& gv: m.global_values()) {
+      if (gv.isDeclaration())
+        continue;
+      numDefs++;
+      if (!gv.hasLocalLinkage() && requested.count(mangle(gv.getName())))
+        defs.insert(&gv);
+    }
+    addConversionDependencies(m, defs);
+
+    if (defs.size() < numDefs) {
+      /* the local definitions of the partition used by the rest of the
+       * module become hidden symbols of the JITDylib */
+      SymbolFlagsMap promoted;
+      for (GlobalValue *gv: defs) {
+        if (!gv->hasLocalLinkage() || !isUsedOutside(gv, defs))
+          continue;
+        gv->setName("__fixp_promoted." + gv->getName() + "." + Twine(nextPromotedId++));
+        gv->setLinkage(GlobalValue::ExternalLinkage);
+        gv->setVisibility(GlobalValue::HiddenVisibility);
+        promoted[mangle(gv->getName())] = JITSymbolFlags::fromGlobalValue(*gv);
+      }
+      if (!promoted.empty()) {
+        if (Error err = r.defineMaterializing(std::move(promoted))) {
+          getExecutionSession().reportError(std::move(err));
+          r.failMaterialization();
+          return;
+        }
+      }
+
+      part = cloneToNewContext(tsm, [&](const GlobalValue& gv) { return defs.count(&gv) != 0; }, makeDeclaration);
+
+      for (GlobalValue& gv: m.global_values()) {
+        if (!gv.isDeclaration() && !gv.hasLocalLinkage() && !gv.hasAvailableExternallyLinkage() &&
+            !gv.hasAppendingLinkage())
+          hasRemainder = true;
+      }
+    }
+  }
+
+  if (!part) {
+    convertAndEmit(std::move(r), std::move(tsm));
+    return;
+  }
+  /* the rest of the module goes back to this layer, and is partitioned
+   * again when one of its symbols is looked up. If only local definitions
+   * are left, nothing can use them. */
+  if (hasRemainder)
+    r.replace(std::make_unique<BasicIRLayerMaterializationUnit>(*this, r.getVModuleKey(), std::move(tsm)));
+  convertAndEmit(std::move(r), std::move(part));
+}
+
+
+void FloatToFixedLayer::convertAndEmit(MaterializationResponsibility r, ThreadSafeModule tsm)
+{
+  {
+    ThreadSafeContext::Lock lock = tsm.getContext().getLock();
+    Module& m = *tsm.getModule();
+
+    /* the symbols of the module were fixed when it was added */
+    StringSet<> interface;
+    for (GlobalValue& gv: m.global_values()) {
+      if (gv.isDeclaration() || gv.hasLocalLinkage())
+        continue;
+      interface.insert(gv.getName());
+      /* they must be emitted even if the conversion leaves them unused, so
+       * that the dead clones can be removed */
+      if (gv.hasLinkOnceLinkage())
+        gv.setLinkage(gv.hasLinkOnceODRLinkage() ? GlobalValue::WeakODRLinkage : GlobalValue::WeakAnyLinkage);
+    }
+
+    ConversionResult res = converter.convert(m);
+
+    for (GlobalValue& gv: m.global_values()) {
+      if (gv.isDeclaration() || gv.hasLocalLinkage() || gv.hasAppendingLinkage() ||
+          interface.count(gv.getName()))
+        continue;
+      gv.setLinkage(GlobalValue::InternalLinkage);
+      gv.setVisibility(GlobalValue::DefaultVisibility);
+    }
+
+    if (notifyConverted)
+      notifyConverted(m, res);
+  }
+
+  baseLayer.emit(std::move(r), std::move(tsm));
+}
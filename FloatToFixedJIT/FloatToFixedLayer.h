@@ -0,0 +1,68 @@
+#include <atomic>
+#include <functional>
+#include "llvm/IR/Module.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/ExecutionEngine/Orc/Core.h"
+#include "llvm/ExecutionEngine/Orc/Layer.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "FloatToFixedConverter.h"
+
+
+#ifndef __FLOAT_TO_FIXED_LAYER_H__
+#define __FLOAT_TO_FIXED_LAYER_H__
+
+
+namespace flttofix {
+
+
+/** ORC layer which converts to fixed point the modules processed by the
+ *  TAFFO analyses when they are materialized, that is when one of their
+ *  symbols is looked up for the first time, instead of when they are added.
+ *  Only the definitions needed by the symbols looked up are converted and
+ *  emitted (see addConversionDependencies()); the rest of the module stays
+ *  in this layer until one of its symbols is looked up.
+ *
+ *  The conversion clones the callees at their call sites, so it must see
+ *  the bodies of all the clones called by the code it converts. The layer
+ *  must never be placed below a CompileOnDemandLayer, which would hand it
+ *  partitions whose callees are only declarations. It can be placed above
+ *  one, so that the converted code is then compiled function by function:
+ *
+ *    IRCompileLayer <- CompileOnDemandLayer <- FloatToFixedLayer
+ *
+ *  The symbols added by the conversion are internalized, because the
+ *  interface of a module cannot change after it has been added. For the
+ *  same reason the original functions which are part of the interface are
+ *  always emitted, while the local ones are removed when the conversion
+ *  leaves them unused (FloatToFixedOptions::removeDeadClones). The local
+ *  definitions shared by different parts of a module become hidden
+ *  symbols. */
+class FloatToFixedLayer : public llvm::orc::IRLayer {
+public:
+  using NotifyConvertedFunction = std::function<void(llvm::Module&, const ConversionResult&)>;
+
+  FloatToFixedLayer(llvm::orc::ExecutionSession& es, llvm::orc::IRLayer& baseLayer,
+    const FloatToFixedOptions& options = FloatToFixedOptions::fromCommandLine(),
+    llvm::TargetIRAnalysis tira = llvm::TargetIRAnalysis());
+
+  /** Sets a function called after the conversion of every module, or of
+   *  every part of it, with the context of the module locked */
+  void setNotifyConverted(NotifyConvertedFunction notifyConverted) { this->notifyConverted = std::move(notifyConverted); }
+
+  void emit(llvm::orc::MaterializationResponsibility r, llvm::orc::ThreadSafeModule tsm) override;
+
+private:
+  llvm::orc::IRLayer& baseLayer;
+  FloatToFixedConverter converter;
+  NotifyConvertedFunction notifyConverted;
+  /** Suffix of the names of the promoted local symbols */
+  std::atomic<unsigned> nextPromotedId{0};
+
+  void convertAndEmit(llvm::orc::MaterializationResponsibility r, llvm::orc::ThreadSafeModule tsm);
+};
+
+
+}
+
+
+#endif
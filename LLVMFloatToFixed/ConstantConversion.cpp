@@ -1,5 +1,8 @@
 #include <cmath>
 #include <cassert>
+#include <cstring>
+#include <limits>
+#include <thread>
 #include "llvm/Pass.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Function.h"
@@ -12,6 +15,8 @@
 #include "llvm/ADT/APSInt.h"
 #include "llvm/ADT/APFloat.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ThreadPool.h"
 #include "llvm/Analysis/OptimizationRemarkEmitter.h"
 #include "LLVMFloatToFixedPass.h"
 #include "TypeUtils.h"
@@ -65,6 +70,7 @@ Constant *FloatToFixed::convertConstantExpr(ConstantExpr *cexp, FixedPointType&
       vals.push_back(cexp->getOperand(i));
     }
 
+    remapGEPIndices(newconst->getType(), vals);
     ArrayRef<Constant *> idxlist(vals);
     return ConstantExpr::getInBoundsGetElementPtr(nullptr, newconst, idxlist);
   }
@@ -72,9 +78,44 @@ Constant *FloatToFixed::convertConstantExpr(ConstantExpr *cexp, FixedPointType&
 }
 
 
+/* Returns if the address of a value may be compared, stored or passed to
+ * some code, instead of being only used for loading from it */
+static bool isAddressObserved(Value *v)
+{
+  for (User *u: v->users()) {
+    if (isa<LoadInst>(u))
+      continue;
+    if (isa<GetElementPtrInst>(u) || isa<BitCastInst>(u)) {
+      if (isAddressObserved(u))
+        return true;
+      continue;
+    }
+    if (ConstantExpr *cexp = dyn_cast<ConstantExpr>(u)) {
+      if ((cexp->getOpcode() == Instruction::GetElementPtr || cexp->getOpcode() == Instruction::BitCast) &&
+          !isAddressObserved(cexp))
+        continue;
+    }
+    return true;
+  }
+  return false;
+}
+
+
 Constant *FloatToFixed::convertGlobalVariable(GlobalVariable *glob, FixedPointType& fixpt, TypeMatchPolicy typepol)
 {
   bool hasfloats;
+  bool narrow = false;
+  FixedPointType storaget;
+  if (getNarrowStorageType(glob, fixpt, storaget)) {
+    LLVM_DEBUG(dbgs() << "storing " << *glob << " as " << storaget << " instead of " << fixpt << "\n");
+    fixpt = storaget;
+    narrow = true;
+    if (hasInfo(glob))
+      valueInfo(glob)->isNarrowStorage = true;
+    NarrowStorageCount++;
+    result.narrowStorageArrays++;
+  }
+  
   Type *prevt = glob->getType()->getPointerElementType();
   Type *newt = getLLVMFixedPointTypeForFloatType(prevt, fixpt, &hasfloats);
   if (!newt)
@@ -90,15 +131,58 @@ Constant *FloatToFixed::convertGlobalVariable(GlobalVariable *glob, FixedPointTy
   } else
     newinit = Constant::getNullValue(newt);
   
+  unsigned align = glob->getAlignment();
+  if (narrow) {
+    Function *user = nullptr;
+    for (User *u: glob->users()) {
+      if (Instruction *i = dyn_cast<Instruction>(u)) {
+        user = i->getFunction();
+        break;
+      }
+    }
+    align = getVectorFriendlyAlignment(newt, user, align);
+  }
+  
+  /* read-only tables with the same contents can share the same storage
+   * if nobody can tell them apart by their address */
+  bool mergeable = options.mergeConstantGlobals && newinit && glob->isConstant() && glob->hasLocalLinkage() &&
+    !glob->isThreadLocal() && !glob->hasSection() && !glob->hasComdat() &&
+    (glob->hasGlobalUnnamedAddr() || !isAddressObserved(glob));
+  ConstantGlobalKey key(newinit, fixpt.toString(), glob->getAddressSpace());
+  if (mergeable) {
+    auto other = mergedConstantGlobals.find(key);
+    if (other != mergedConstantGlobals.end()) {
+      GlobalVariable *othglob = other->second;
+      unsigned abialign = dataLayout->getABITypeAlignment(newt);
+      unsigned othalign = othglob->getAlignment() ? othglob->getAlignment() : abialign;
+      if ((align ? align : abialign) > othalign)
+        othglob->setAlignment(MaybeAlign(align));
+      LLVM_DEBUG(dbgs() << "converted " << *glob << " shares " << othglob->getName() << "\n");
+      MergedConstantGlobalCount++;
+      result.mergedConstantGlobals++;
+      return othglob;
+    }
+  }
+  
   GlobalVariable *newglob = new GlobalVariable(*(glob->getParent()), newt, glob->isConstant(), glob->getLinkage(), newinit);
-  newglob->setAlignment(glob->getAlignment());
+  newglob->setAlignment(MaybeAlign(align));
   newglob->setName(glob->getName() + ".fixp");
+  if (mergeable) {
+    newglob->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+    mergedConstantGlobals[key] = newglob;
+  }
   return newglob;
 }
 
 
+
 Constant *FloatToFixed::convertConstantAggregate(ConstantAggregate *cag, FixedPointType& fixpt, TypeMatchPolicy typepol)
 {
+  if (ConstantStruct *strt = dyn_cast<ConstantStruct>(cag)) {
+    if (packableStructs.count(strt->getType()))
+      return convertPackableConstantStruct(strt, fixpt);
+  }
+
   std::vector<Constant*> consts;
   for (int i=0; i<cag->getNumOperands(); i++) {
     Constant *oldconst = cag->getOperand(i);
@@ -133,18 +217,141 @@ Constant *FloatToFixed::convertConstantAggregate(ConstantAggregate *cag, FixedPo
 }
 
 
+Constant *FloatToFixed::convertPackableConstantStruct(ConstantStruct *strt, FixedPointType& fixpt)
+{
+  /* the fields may have been reordered, and each one has its own type */
+  StructType *strtype = dyn_cast<StructType>(getLLVMFixedPointTypeForFloatType(strt->getType(), fixpt));
+  if (!strtype || strtype->getNumElements() != strt->getNumOperands())
+    return nullptr;
+  
+  std::vector<Constant *> newconsts(strt->getNumOperands());
+  for (unsigned i = 0; i < strt->getNumOperands(); i++) {
+    Constant *oldconst = strt->getOperand(i);
+    Constant *newconst = oldconst;
+    if (isFloatType(oldconst->getType())) {
+      newconst = convertConstant(oldconst, fixpt.structItem(i), TypeMatchPolicy::ForceHint);
+      if (!newconst)
+        return nullptr;
+    }
+    unsigned newidx = remapStructIndex(strtype, i);
+    if (newconst->getType() != strtype->getElementType(newidx)) {
+      LLVM_DEBUG(dbgs() << "field " << i << " of " << *strt << " converted to " << *newconst->getType()
+        << " instead of " << *strtype->getElementType(newidx) << "\n");
+      return nullptr;
+    }
+    newconsts[newidx] = newconst;
+  }
+  return ConstantStruct::get(strtype, newconsts);
+}
+
+
+/* Converts natively the elements [begin, end) of a float or double array
+ * to fixed point. The result matches convertAPFloat() exactly as long as
+ * the scaling by 2^frac does not overflow or underflow and the result fits
+ * in the fixed point type; the other elements are appended to slow and
+ * shall be converted with convertAPFloat(). */
+template <class F, class T>
+static void convertNativeChunk(const char *data, size_t begin, size_t end, const FixedPointType& fixpt,
+  T *res, std::vector<size_t>& slow)
+{
+  int frac = fixpt.scalarFracBitsAmt();
+  bool issigned = fixpt.scalarIsSigned();
+  int bits = fixpt.scalarBitsAmt();
+  double lo = issigned ? -std::ldexp(1.0, bits - 1) : 0.0;
+  double hi = std::ldexp(1.0, issigned ? bits - 1 : bits);
+  double minnorm = std::numeric_limits<F>::min();
+  double maxnorm = std::numeric_limits<F>::max();
+
+  for (size_t i = begin; i < end; i++) {
+    F elem;
+    std::memcpy(&elem, data + i * sizeof(F), sizeof(F));
+    /* exact in double for both float and double elements; it is also
+     * exact in F (as the multiplication done by convertAPFloat) when the
+     * result is a normal F */
+    double scaled = std::ldexp((double)elem, frac);
+    double absscaled = std::fabs(scaled);
+    bool exact = elem == 0 || (std::isnormal(elem) && absscaled >= minnorm && absscaled <= maxnorm);
+    /* rounding towards negative infinity, like convertToInteger() */
+    double fl = std::floor(scaled);
+    if (!exact || !(fl >= lo && fl < hi)) {
+      slow.push_back(i);
+      continue;
+    }
+    res[i] = issigned ? (T)(int64_t)fl : (T)(uint64_t)fl;
+  }
+}
+
+
+/* Converts natively the elements of a float or double constant array,
+ * with nthreads threads (0 = one per hardware thread) for large arrays.
+ * @returns false if the native conversion is not applicable at all. */
+template <class T>
+static bool convertConstantDataNative(ConstantDataSequential *cds, const FixedPointType& fixpt,
+  T *res, std::vector<size_t>& slow, unsigned nthreads)
+{
+  Type *elemt = cds->getElementType();
+  bool isdouble = elemt->isDoubleTy();
+  if (!isdouble && !elemt->isFloatTy())
+    return false;
+  /* 2^frac must be a normal number in the element type */
+  int frac = fixpt.scalarFracBitsAmt();
+  int minexp = isdouble ? std::numeric_limits<double>::min_exponent : std::numeric_limits<float>::min_exponent;
+  int maxexp = isdouble ? std::numeric_limits<double>::max_exponent : std::numeric_limits<float>::max_exponent;
+  if (frac < minexp - 1 || frac >= maxexp || fixpt.scalarBitsAmt() > 64)
+    return false;
+
+  const char *data = cds->getRawDataValues().data();
+  size_t n = cds->getNumElements();
+  auto convertChunk = [&](size_t begin, size_t end, std::vector<size_t>& chunkslow) {
+    if (isdouble)
+      convertNativeChunk<double, T>(data, begin, end, fixpt, res, chunkslow);
+    else
+      convertNativeChunk<float, T>(data, begin, end, fixpt, res, chunkslow);
+  };
+
+  const size_t chunksize = 1 << 16;
+  if (nthreads == 0)
+    nthreads = std::max(1u, std::thread::hardware_concurrency());
+  if (nthreads == 1 || n < 2 * chunksize) {
+    convertChunk(0, n, slow);
+    return true;
+  }
+
+  size_t nchunks = (n + chunksize - 1) / chunksize;
+  std::vector<std::vector<size_t>> chunkslow(nchunks);
+  ThreadPool pool(std::min<size_t>(nthreads, nchunks));
+  for (size_t c = 0; c < nchunks; c++) {
+    pool.async([&, c]() {
+      convertChunk(c * chunksize, std::min(n, (c + 1) * chunksize), chunkslow[c]);
+    });
+  }
+  pool.wait();
+  for (std::vector<size_t>& cs: chunkslow)
+    slow.insert(slow.end(), cs.begin(), cs.end());
+  return true;
+}
+
+
 template <class T> Constant *FloatToFixed::createConstantDataSequential(ConstantDataSequential *cds, const FixedPointType& fixpt)
 {
-  std::vector<T> newConsts;
+  size_t n = cds->getNumElements();
+  std::vector<T> newConsts(n);
+  
+  std::vector<size_t> slow;
+  if (!convertConstantDataNative(cds, fixpt, newConsts.data(), slow, options.constantConversionThreads)) {
+    for (size_t i = 0; i < n; i++)
+      slow.push_back(i);
+  }
+  LLVM_DEBUG(dbgs() << "converted " << n - slow.size() << " of " << n << " elements of a constant array natively\n");
   
-  for (int i=0; i<cds->getNumElements(); i++) {
+  for (size_t i: slow) {
     APFloat thiselem = cds->getElementAsAPFloat(i);
     APSInt fixval;
     if (!convertAPFloat(thiselem, fixval, nullptr, fixpt)) {
       LLVM_DEBUG(dbgs() << *cds << " conv failed because an apfloat cannot be converted to " << fixpt << "\n");
       return nullptr;
     }
-    newConsts.push_back(fixval.getExtValue());
+    newConsts[i] = fixval.getExtValue();
   }
   
   if (isa<ConstantDataArray>(cds)) {
@@ -174,6 +381,33 @@ Constant *FloatToFixed::convertConstantDataSequential(ConstantDataSequential *cd
 
 
 Constant *FloatToFixed::convertLiteral(ConstantFP *fpc, Instruction *context, FixedPointType& fixpt, TypeMatchPolicy typepol)
+{
+  /* without a context the conversion has no side effects and never fails,
+   * so it depends only on the literal, on the policy and on the
+   * requested type (only on its width, if the type is chosen from the
+   * range) */
+  LiteralCacheKey key;
+  if (!context) {
+    bool hint = isHintPreferredPolicy(typepol);
+    key = LiteralCacheKey(fpc, (int)typepol, hint && fixpt.scalarIsSigned(),
+      hint ? fixpt.scalarFracBitsAmt() : 0, fixpt.scalarBitsAmt());
+    auto cached = literalCache.find(key);
+    if (cached != literalCache.end()) {
+      LiteralCacheHitCount++;
+      result.literalCacheHits++;
+      fixpt = cached->second.first;
+      return cached->second.second;
+    }
+  }
+  
+  Constant *res = convertLiteralUncached(fpc, context, fixpt, typepol);
+  if (!context)
+    literalCache[key] = std::make_pair(fixpt, res);
+  return res;
+}
+
+
+Constant *FloatToFixed::convertLiteralUncached(ConstantFP *fpc, Instruction *context, FixedPointType& fixpt, TypeMatchPolicy typepol)
 {
   APFloat val = fpc->getValueAPF();
   APSInt fixval;
@@ -8,11 +8,15 @@
 #include "llvm/IR/InstIterator.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/InstrTypes.h"
+#include "llvm/IR/Intrinsics.h"
 #include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/APSInt.h"
 #include "llvm/ADT/APFloat.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/MathExtras.h"
 #include <bits/stdc++.h>
 #include "LLVMFloatToFixedPass.h"
 #include "TypeUtils.h"
@@ -26,17 +30,14 @@ using namespace flttofix;
 using namespace taffo;
 
 
-Value *ConversionError = (Value *)(&ConversionError);
-Value *Unsupported = (Value *)(&Unsupported);
-
-
 void FloatToFixed::performConversion(
   Module& m,
   std::vector<Value*>& q)
 {
 
   ofstream conversionFile;
-  conversionFile.open ("conversion");
+  if (!options.conversionLog.empty())
+    conversionFile.open(options.conversionLog);
   
   for (auto i = q.begin(); i != q.end();) {
     Value *v = *i;
@@ -88,23 +89,13 @@ void FloatToFixed::performConversion(
 
         std::string functionStr = "";
 
-        if(CallInst *callInstruction = dyn_cast<CallInst>(v)) {
-          const TargetLibraryInfo *TLI; 
+        if(conversionFile.is_open() && isa<CallInst>(v)) {
+          CallInst *callInstruction = cast<CallInst>(v);
           LibFunc inbuilt_func;
-          std::set<StringRef> builtins;
-
-          /* Gather all built-in functions 
-            --------------------- */
-          for (auto &F : m)
-          {
-            if (TLI->getLibFunc(F, inbuilt_func))
-                builtins.insert(F.getFunction().getName());
-          }       
-          // Cast into Function pointer
           Function *called_func = callInstruction->getCalledFunction();
-          StringRef func_name = called_func->getName();
+          const TargetLibraryInfo& TLI = getAnalysis<TargetLibraryInfoWrapperPass>().getTLI(*oldinst->getFunction());
           // This line checks to see if the function is not a builtin-function
-          if (builtins.count(func_name)==0)
+          if (!called_func || !TLI.getLibFunc(*called_func, inbuilt_func))
           {
             functionStr = "NOT-BUILT-IN";
           }
@@ -118,19 +109,27 @@ void FloatToFixed::performConversion(
         /*conversionFile << "New type: -" + (valueInfo(v)->fixpType).toString() + "-Old type: -" + rso.str()
         
         + "-LINE: -" + to_string(location.getLine()) + "-COLUMN: -" + to_string(location.getCol())  + "-OPCODE: -" + oldinst->getOpcodeName() + "-" + operators + "-" + functionStr<< endl; */
-        if(location) {
+        if(!conversionFile.is_open()) {
+          /* no conversion log */
+        }
+        else if(location) {
           conversionFile << to_string(location.getLine()) + " " + to_string(location.getCol())  + " " + oldinst->getOpcodeName() + " " + functionStr<< endl;
         }
         else {
-          printf("location is NULL\n");
+          LLVM_DEBUG(dbgs() << "location is NULL\n");
         }
       }
-      cpMetaData(newv,v);
-      if (newv != v) {
-        if (hasInfo(newv)) {
-          LLVM_DEBUG(dbgs() << "warning: output has valueInfo already from a previous conversion\n");
-        } else {
-          *newValueInfo(newv) = *valueInfo(v);
+      /* uniqued constants, like the comparisons folded to true or false,
+       * are shared by the whole context and must not take the metadata
+       * and the information of a single value */
+      if (!isa<ConstantData>(newv)) {
+        cpMetaData(newv,v);
+        if (newv != v) {
+          if (hasInfo(newv)) {
+            LLVM_DEBUG(dbgs() << "warning: output has valueInfo already from a previous conversion\n");
+          } else {
+            *newValueInfo(newv) = *valueInfo(v);
+          }
         }
       }
     } else {
@@ -230,14 +229,11 @@ Value *FloatToFixed::translateOrMatchOperand(Value *val, FixedPointType& iofixpt
   
   /* not an easy case; check if the value has a range metadata
    * from VRA before giving up and using the suggested type */
-  mdutils::MDInfo *mdi = mdutils::MetadataManager::getMetadataManager().retrieveMDInfo(val);
-  if (mdutils::InputInfo *ii = dyn_cast_or_null<mdutils::InputInfo>(mdi)) {
-    if (ii->IRange) {
-      FixedPointTypeGenError err;
-      mdutils::FPType fpt = taffo::fixedPointTypeFromRange(*(ii->IRange), &err, iofixpt.scalarBitsAmt());
-      if (err != FixedPointTypeGenError::InvalidRange)
-        iofixpt = FixedPointType(&fpt);
-    }
+  if (Optional<mdutils::Range> range = getValueRange(val)) {
+    FixedPointTypeGenError err;
+    mdutils::FPType fpt = taffo::fixedPointTypeFromRange(*range, &err, iofixpt.scalarBitsAmt());
+    if (err != FixedPointTypeGenError::InvalidRange)
+      iofixpt = FixedPointType(&fpt);
   }
   
   return genConvertFloatToFix(val, iofixpt, ip);
@@ -266,20 +262,22 @@ Value *FloatToFixed::genConvertFloatToFix(Value *flt, const FixedPointType& fixp
   assert(ip && "ip is mandatory if not passing an instruction/constant value");
   
   FloatToFixCount++;
-  FloatToFixWeight += std::pow(2, std::min((int)(sizeof(int)*8-1), this->getLoopNestingLevelOfValue(flt)));
+  result.floatToFixConversions++;
+  FloatToFixWeight += this->getExecutionWeightOfValue(flt);
   
   IRBuilder<> builder(ip);
   Type *destt = getLLVMFixedPointTypeForFloatType(flt->getType(), fixpt);
   
   /* insert new instructions before ip */
+  Value *res;
   if (SIToFPInst *instr = dyn_cast<SIToFPInst>(flt)) {
     Value *intparam = instr->getOperand(0);
-    return cpMetaData(builder.CreateShl(
+    res = cpMetaData(builder.CreateShl(
               cpMetaData(builder.CreateIntCast(intparam, destt, true),flt,ip),
             fixpt.scalarFracBitsAmt()),flt,ip);
   } else if (UIToFPInst *instr = dyn_cast<UIToFPInst>(flt)) {
     Value *intparam = instr->getOperand(0);
-    return cpMetaData(builder.CreateShl(
+    res = cpMetaData(builder.CreateShl(
               cpMetaData(builder.CreateIntCast(intparam, destt, false),flt,ip),
             fixpt.scalarFracBitsAmt()),flt,ip);
   } else {
@@ -288,11 +286,13 @@ Value *FloatToFixed::genConvertFloatToFix(Value *flt, const FixedPointType& fixp
           cpMetaData(ConstantFP::get(flt->getType(), twoebits),flt,ip),
         flt),flt,ip);
     if (fixpt.scalarIsSigned()) {
-      return cpMetaData(builder.CreateFPToSI(interm, destt),flt,ip);
+      res = cpMetaData(builder.CreateFPToSI(interm, destt),flt,ip);
     } else {
-      return cpMetaData(builder.CreateFPToUI(interm, destt),flt,ip);
+      res = cpMetaData(builder.CreateFPToUI(interm, destt),flt,ip);
     }
   }
+  instrumentConversion(res, flt, ConversionSiteKind::FloatToFix);
+  return res;
 }
 
 
@@ -311,7 +311,6 @@ Value *FloatToFixed::genConvertFixedToFixed(Value *fix, const FixedPointType& sr
   if (!ip && fixinst)
     ip = getFirstInsertionPointAfter(fixinst);
   assert(ip && "ip required when converted value not an instruction");
-
   IRBuilder<> builder(ip);
 
   auto genSizeChange = [&](Value *fix) -> Value* {
@@ -336,9 +335,13 @@ Value *FloatToFixed::genConvertFixedToFixed(Value *fix, const FixedPointType& sr
     return fix;
   };
   
+  Value *res;
   if (destt.scalarBitsAmt() > srct.scalarBitsAmt())
-    return genPointMovement(genSizeChange(fix));
-  return genSizeChange(genPointMovement(fix));
+    res = genPointMovement(genSizeChange(fix));
+  else
+    res = genSizeChange(genPointMovement(fix));
+  instrumentConversion(res, fix, ConversionSiteKind::FixToFix);
+  return res;
 }
 
 
@@ -358,7 +361,8 @@ Value *FloatToFixed::genConvertFixToFloat(Value *fix, const FixedPointType& fixp
   }
   
   FixToFloatCount++;
-  FixToFloatWeight += std::pow(2, std::min((int)(sizeof(int)*8-1), this->getLoopNestingLevelOfValue(fix)));
+  result.fixToFloatConversions++;
+  FixToFloatWeight += this->getExecutionWeightOfValue(fix);
   
   if (isa<Instruction>(fix) || isa<Argument>(fix)) {
     Instruction *ip = nullptr;
@@ -372,8 +376,10 @@ Value *FloatToFixed::genConvertFixToFloat(Value *fix, const FixedPointType& fixp
     Value *floattmp = fixpt.scalarIsSigned() ? builder.CreateSIToFP(fix, destt) : builder.CreateUIToFP(fix, destt);
     cpMetaData(floattmp,fix);
     double twoebits = pow(2.0, fixpt.scalarFracBitsAmt());
-    return cpMetaData(builder.CreateFDiv(floattmp,
+    Value *res = cpMetaData(builder.CreateFDiv(floattmp,
                                          cpMetaData(ConstantFP::get(destt, twoebits), fix)),fix);
+    instrumentConversion(res, fix, ConversionSiteKind::FixToFloat);
+    return res;
     
   } else if (Constant *cst = dyn_cast<Constant>(fix)) {
     Constant *floattmp = fixpt.scalarIsSigned() ?
@@ -417,9 +423,12 @@ Type *FloatToFixed::getLLVMFixedPointTypeForFloatType(Type *srct, const FixedPoi
       }
       elems.push_back(newelemt);
     }
-    if (!allinvalid)
-      return StructType::get(srct->getContext(), elems, dyn_cast<StructType>(srct)->isPacked());
-    return srct;
+    if (allinvalid)
+      return srct;
+    StructType *oldst = cast<StructType>(srct);
+    if (packableStructs.count(oldst))
+      return getPackedStructType(oldst, baset, elems);
+    return StructType::get(srct->getContext(), elems, oldst->isPacked());
     
   } else if (srct->isFloatingPointTy()) {
     if (hasfloats)
@@ -446,3 +455,120 @@ Type *FloatToFixed::getLLVMFixedPointTypeForFloatValue(Value *val)
 
 
 
+
+
+/* Returns if the memory pointed by ptr is only accessed through loads and
+ * stores of its own type, thus its storage format can be changed freely */
+static bool hasOnlyTypedMemoryUses(Value *ptr)
+{
+  for (User *u: ptr->users()) {
+    if (isa<LoadInst>(u))
+      continue;
+    if (StoreInst *store = dyn_cast<StoreInst>(u)) {
+      if (store->getValueOperand() == ptr)
+        return false;
+      continue;
+    }
+    if (isa<GetElementPtrInst>(u)) {
+      if (!hasOnlyTypedMemoryUses(u))
+        return false;
+      continue;
+    }
+    if (isa<BitCastInst>(u)) {
+      /* annotations and lifetime markers do not access the memory */
+      for (User *bcu: u->users()) {
+        CallInst *call = dyn_cast<CallInst>(bcu);
+        Function *callee = call ? call->getCalledFunction() : nullptr;
+        if (!callee)
+          return false;
+        if (callee->getName() != "llvm.var.annotation" &&
+            callee->getIntrinsicID() != Intrinsic::lifetime_start &&
+            callee->getIntrinsicID() != Intrinsic::lifetime_end)
+          return false;
+      }
+      continue;
+    }
+    if (ConstantExpr *cexp = dyn_cast<ConstantExpr>(u)) {
+      /* references from the global annotation table */
+      if (cexp->getOpcode() != Instruction::BitCast)
+        return false;
+      for (User *ceu: cexp->users()) {
+        if (!isa<ConstantAggregate>(ceu))
+          return false;
+      }
+      continue;
+    }
+    return false;
+  }
+  return true;
+}
+
+
+bool FloatToFixed::getNarrowStorageType(Value *memobj, const FixedPointType& fixpt, FixedPointType& storaget)
+{
+  if (!options.narrowStorage)
+    return false;
+  
+  Type *allocatedt = memobj->getType()->getPointerElementType();
+  if (!allocatedt->isArrayTy() || !fullyUnwrapPointerOrArrayType(allocatedt)->isFloatingPointTy())
+    return false;
+  if (fixpt.isInvalid())
+    return false;
+  
+  Optional<mdutils::Range> range = getValueRange(memobj);
+  if (!range)
+    return false;
+  if (!hasOnlyTypedMemoryUses(memobj)) {
+    LLVM_DEBUG(dbgs() << "not narrowing storage of " << *memobj << " because it escapes\n");
+    return false;
+  }
+  
+  double min = range->Min, max = range->Max;
+  bool issigned = min < 0;
+  double maxabs = std::max(std::abs(min), std::abs(max));
+  int intbits = (maxabs < 1.0 ? 0 : (int)std::floor(std::log2(maxabs)) + 1) + (issigned ? 1 : 0);
+  
+  for (int bits = 8; bits < fixpt.scalarBitsAmt(); bits *= 2) {
+    int fracbits = std::min(bits - intbits, fixpt.scalarFracBitsAmt());
+    if (fracbits < 0 || fixpt.scalarFracBitsAmt() - fracbits > (int)options.narrowStorageMaxFracLoss)
+      continue;
+    storaget = FixedPointType(issigned, fracbits, bits);
+    return true;
+  }
+  return false;
+}
+
+
+unsigned FloatToFixed::getVectorFriendlyAlignment(Type *t, Function *f, unsigned oldalign)
+{
+  if (!f)
+    return oldalign;
+  const DataLayout& dl = f->getParent()->getDataLayout();
+  const TargetTransformInfo& tti = getAnalysis<TargetTransformInfoWrapperPass>().getTTI(*f);
+  uint64_t vecbytes = tti.getRegisterBitWidth(true) / 8;
+  uint64_t align = std::min(vecbytes, PowerOf2Floor(dl.getTypeAllocSize(t)));
+  return std::max((uint64_t)oldalign, align);
+}
+
+
+int FloatToFixed::getLegalIntegerWidth(int bits, Function *f)
+{
+  if (!options.legalIntermediates || !f)
+    return bits;
+  const DataLayout& dl = f->getParent()->getDataLayout();
+  if (dl.isLegalInteger(bits))
+    return bits;
+  if (Type *legalt = dl.getSmallestLegalIntType(f->getContext(), bits))
+    return legalt->getIntegerBitWidth();
+  
+  /* modules without a data layout do not specify the native integer
+   * widths; ask the target */
+  const TargetTransformInfo& tti = getAnalysis<TargetTransformInfoWrapperPass>().getTTI(*f);
+  for (int w = 8; w <= 64; w *= 2) {
+    if (w >= bits && tti.isTypeLegal(IntegerType::get(f->getContext(), w)))
+      return w;
+  }
+  /* wider than any native integer: power of two widths are split in
+   * registers more cheaply */
+  return std::max<int>(8, PowerOf2Ceil(bits));
+}
@@ -0,0 +1,116 @@
+#include "llvm/Pass.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+#include "LLVMFloatToFixedPass.h"
+
+using namespace llvm;
+using namespace flttofix;
+
+
+void FloatToFixed::instrumentConversion(Value *conv, Value *origin, ConversionSiteKind kind)
+{
+  if (!options.instrumentConversions)
+    return;
+  /* folded to a constant, or nothing to convert */
+  Instruction *convi = dyn_cast_or_null<Instruction>(conv);
+  if (!convi || convi == origin)
+    return;
+
+  ConversionSite site;
+  site.kind = kind;
+  site.function = convi->getFunction()->getName().str();
+  DebugLoc loc;
+  if (Instruction *i = dyn_cast_or_null<Instruction>(origin))
+    loc = i->getDebugLoc();
+  if (!loc)
+    loc = convi->getDebugLoc();
+  if (DILocation *diloc = loc.get()) {
+    site.file = diloc->getFilename().str();
+    site.line = diloc->getLine();
+    site.column = diloc->getColumn();
+  }
+  pendingConversions.push_back(std::make_tuple(WeakVH(convi), site, loc));
+}
+
+
+void FloatToFixed::finalizeConversionInstrumentation(Module& m)
+{
+  /* the conversions replaced by other values (e.g. the normalized products
+   * used only by fused additions) have been erased or are no longer used */
+  std::vector<std::tuple<WeakVH, ConversionSite, DebugLoc>> emitted;
+  for (auto& conv: pendingConversions) {
+    Instruction *i = cast_or_null<Instruction>((Value *)std::get<0>(conv));
+    if (i && !i->use_empty())
+      emitted.push_back(conv);
+  }
+  pendingConversions.clear();
+  if (emitted.empty())
+    return;
+
+  LLVMContext& ctxt = m.getContext();
+  Type *i64 = Type::getInt64Ty(ctxt);
+  Type *i32 = Type::getInt32Ty(ctxt);
+  Type *i8ptr = Type::getInt8PtrTy(ctxt);
+  uint64_t n = emitted.size();
+
+  ArrayType *countert = ArrayType::get(i64, n);
+  GlobalVariable *counters = new GlobalVariable(m, countert, false, GlobalValue::InternalLinkage,
+    ConstantAggregateZero::get(countert), "taffo.conv.counters");
+  for (uint64_t k = 0; k < n; k++) {
+    Instruction *conv = cast<Instruction>((Value *)std::get<0>(emitted[k]));
+    Constant *idx[] = {ConstantInt::get(i64, 0), ConstantInt::get(i64, k)};
+    Constant *counter = ConstantExpr::getGetElementPtr(nullptr, counters, idx);
+    IRBuilder<> builder(conv);
+    builder.SetCurrentDebugLocation(std::get<2>(emitted[k]));
+    builder.CreateAtomicRMW(AtomicRMWInst::Add, counter, ConstantInt::get(i64, 1), AtomicOrdering::Monotonic);
+    LLVM_DEBUG(dbgs() << "instrumented conversion site " << k << " at " << std::get<1>(emitted[k]).file << ":" <<
+      std::get<1>(emitted[k]).line << "\n");
+  }
+
+  /* struct taffo_conv_site { const char *file, *function; uint32_t line, column, kind; } */
+  StructType *sitet = StructType::get(ctxt, {i8ptr, i8ptr, i32, i32, i32});
+  StringMap<Constant *> strings;
+  auto getString = [&](StringRef str) -> Constant * {
+    Constant *& res = strings[str];
+    if (!res) {
+      Constant *init = ConstantDataArray::getString(ctxt, str);
+      GlobalVariable *gv = new GlobalVariable(m, init->getType(), true, GlobalValue::PrivateLinkage, init, "taffo.conv.str");
+      gv->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+      res = ConstantExpr::getPointerCast(gv, i8ptr);
+    }
+    return res;
+  };
+  std::vector<Constant *> sites;
+  for (auto& conv: emitted) {
+    const ConversionSite& site = std::get<1>(conv);
+    sites.push_back(ConstantStruct::get(sitet, {
+      getString(site.file), getString(site.function),
+      ConstantInt::get(i32, site.line), ConstantInt::get(i32, site.column),
+      ConstantInt::get(i32, (unsigned)site.kind)}));
+  }
+  ArrayType *sitearrt = ArrayType::get(sitet, n);
+  GlobalVariable *sitesgv = new GlobalVariable(m, sitearrt, true, GlobalValue::InternalLinkage,
+    ConstantArray::get(sitearrt, sites), "taffo.conv.sites");
+
+  FunctionCallee regfun = m.getOrInsertFunction("__taffo_conv_register", Type::getVoidTy(ctxt),
+    i64->getPointerTo(), sitet->getPointerTo(), i64);
+  Function *ctor = Function::Create(FunctionType::get(Type::getVoidTy(ctxt), false),
+    GlobalValue::InternalLinkage, "taffo.conv.init", &m);
+  IRBuilder<> builder(BasicBlock::Create(ctxt, "entry", ctor));
+  builder.CreateCall(regfun, {
+    ConstantExpr::getPointerCast(counters, i64->getPointerTo()),
+    ConstantExpr::getPointerCast(sitesgv, sitet->getPointerTo()),
+    ConstantInt::get(i64, n)});
+  builder.CreateRetVoid();
+  appendToGlobalCtors(m, ctor, 65535);
+
+  LLVM_DEBUG(dbgs() << "instrumented " << n << " conversion sites\n");
+}
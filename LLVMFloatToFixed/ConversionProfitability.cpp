@@ -0,0 +1,305 @@
+#include <cmath>
+#include "llvm/Pass.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+#include "LLVMFloatToFixedPass.h"
+#include "TypeUtils.h"
+
+using namespace llvm;
+using namespace flttofix;
+using namespace taffo;
+
+
+namespace {
+
+
+/* Estimated cost of a region when converted to fixed point and when
+ * left in floating point */
+struct RegionCost {
+  double fix = 0.0;
+  double flt = 0.0;
+};
+
+
+/** Cost model for a single function, based on the target's cost tables.
+ *  All costs are expressed in TTI units, multiplied by the estimated
+ *  execution weight of the instruction they refer to. The weight is the
+ *  block frequency relative to the function entry if bfi is not null,
+ *  2^loopDepth otherwise. */
+class RegionCostModel {
+public:
+  RegionCostModel(FloatToFixed& pass, Function& f, const TargetTransformInfo& tti, LoopInfo& li, BlockFrequencyInfo *bfi):
+    pass(pass), f(f), tti(tti), li(li), bfi(bfi) { }
+
+  double weight(Value *v) {
+    Instruction *i = dyn_cast<Instruction>(v);
+    if (!i || i->getFunction() != &f)
+      return 1.0;
+    if (bfi)
+      return (double)bfi->getBlockFreq(i->getParent()).getFrequency() / (double)bfi->getEntryFreq();
+    return std::pow(2.0, std::min((int)(sizeof(int)*8-1), (int)li.getLoopDepth(i->getParent())));
+  }
+
+  double floatToFixCost(Type *fltt, Type *intt) {
+    return tti.getArithmeticInstrCost(Instruction::FMul, fltt) +
+      tti.getCastInstrCost(Instruction::FPToSI, intt, fltt);
+  }
+
+  double fixToFloatCost(Type *fltt, Type *intt) {
+    return tti.getCastInstrCost(Instruction::SIToFP, fltt, intt) +
+      tti.getArithmeticInstrCost(Instruction::FDiv, fltt);
+  }
+
+  /** Cost of the operation performed by an instruction, not considering the
+   *  conversions of its operands and of its result. */
+  double operationCost(Instruction *i, Type *intt, bool fixed) {
+    Type *fltt = i->getType();
+    unsigned opc = i->getOpcode();
+
+    if (opc == Instruction::FAdd || opc == Instruction::FSub ||
+        opc == Instruction::FMul || opc == Instruction::FDiv ||
+        opc == Instruction::FRem) {
+      if (!fixed)
+        return tti.getArithmeticInstrCost(opc, fltt);
+      if (opc == Instruction::FAdd)
+        return tti.getArithmeticInstrCost(Instruction::Add, intt);
+      if (opc == Instruction::FSub)
+        return tti.getArithmeticInstrCost(Instruction::Sub, intt);
+      if (opc == Instruction::FRem)
+        return tti.getArithmeticInstrCost(Instruction::SRem, intt);
+
+      /* multiplications and divisions are performed in double width */
+      Type *widet = Type::getIntNTy(i->getContext(), intt->getIntegerBitWidth() * 2);
+      double cost = 2 * tti.getCastInstrCost(Instruction::SExt, widet, intt) +
+        tti.getCastInstrCost(Instruction::Trunc, intt, widet);
+      if (opc == Instruction::FMul)
+        return cost + tti.getArithmeticInstrCost(Instruction::Mul, widet) +
+          tti.getArithmeticInstrCost(Instruction::AShr, widet);
+      return cost + tti.getArithmeticInstrCost(Instruction::Shl, widet) +
+        tti.getArithmeticInstrCost(Instruction::SDiv, widet);
+    }
+
+    if (isa<LoadInst>(i) || isa<PHINode>(i) || isa<SelectInst>(i) || isa<CastInst>(i))
+      return 0.0;
+
+    if (CallInst *call = dyn_cast<CallInst>(i)) {
+      Function *callee = call->getCalledFunction();
+      if (callee && !pass.isSpecialFunction(callee))
+        return 0.0;
+    }
+
+    /* anything else goes through the fallback, which performs the operation
+     * in floating point anyway */
+    double cost = tti.getArithmeticInstrCost(Instruction::FAdd, fltt);
+    if (!fixed)
+      return cost;
+    for (Value *op: i->operands()) {
+      if (op->getType()->isFloatingPointTy() && !isa<Constant>(op))
+        cost += fixToFloatCost(op->getType(), intt);
+    }
+    return cost + floatToFixCost(fltt, intt);
+  }
+
+  /** Adds to the cost of a region the cost of one of its instructions,
+   *  including the conversions on the boundaries of the region. */
+  void addInstruction(Instruction *i, const SmallPtrSetImpl<Value *>& region, RegionCost& cost);
+
+private:
+  FloatToFixed& pass;
+  Function& f;
+  const TargetTransformInfo& tti;
+  LoopInfo& li;
+  BlockFrequencyInfo *bfi;
+
+  bool willBeConverted(Value *v, const SmallPtrSetImpl<Value *>& region) {
+    return region.count(v) || pass.isFloatingPointToConvert(v);
+  }
+};
+
+
+}
+
+
+void RegionCostModel::addInstruction(Instruction *i, const SmallPtrSetImpl<Value *>& region, RegionCost& cost)
+{
+  Type *fltt = i->getType();
+  Type *intt = pass.fixPType(i).scalarToLLVMType(i->getContext());
+  double w = weight(i);
+
+  cost.fix += w * operationCost(i, intt, true);
+  cost.flt += w * operationCost(i, intt, false);
+
+  if (LoadInst *load = dyn_cast<LoadInst>(i)) {
+    if (pass.isFloatingPointToConvert(load->getPointerOperand()))
+      cost.flt += w * fixToFloatCost(fltt, intt);
+    else
+      cost.fix += w * floatToFixCost(fltt, intt);
+  }
+
+  /* conversions of the operands coming from outside the region are placed
+   * right after their definition */
+  for (Value *op: i->operands()) {
+    if (!op->getType()->isFloatingPointTy() || isa<Constant>(op) || region.count(op))
+      continue;
+    if (pass.isFloatingPointToConvert(op))
+      cost.flt += weight(op) * fixToFloatCost(fltt, intt);
+    else
+      cost.fix += weight(op) * floatToFixCost(fltt, intt);
+  }
+
+  /* conversions of the result for the users outside the region */
+  for (User *u: i->users()) {
+    if (region.count(u))
+      continue;
+    if (StoreInst *store = dyn_cast<StoreInst>(u)) {
+      if (pass.isFloatingPointToConvert(store->getPointerOperand()))
+        cost.flt += w * floatToFixCost(fltt, intt);
+      else
+        cost.fix += w * fixToFloatCost(fltt, intt);
+    } else if (FCmpInst *cmp = dyn_cast<FCmpInst>(u)) {
+      Value *other = cmp->getOperand(0) == i ? cmp->getOperand(1) : cmp->getOperand(0);
+      if (!isa<Constant>(other) && !willBeConverted(other, region))
+        cost.fix += w * fixToFloatCost(fltt, intt);
+      else if (!isa<Constant>(other) && !region.count(other))
+        cost.flt += w * floatToFixCost(fltt, intt);
+    } else if (pass.isFloatingPointToConvert(u)) {
+      cost.flt += w * floatToFixCost(fltt, intt);
+    } else {
+      cost.fix += w * fixToFloatCost(fltt, intt);
+    }
+  }
+}
+
+
+void FloatToFixed::pruneColdCode(std::vector<Value *>& q)
+{
+  if (!options.skipColdCode)
+    return;
+  ProfileSummaryInfo& psi = getAnalysis<ProfileSummaryInfoWrapperPass>().getPSI();
+  if (!psi.hasProfileSummary())
+    return;
+
+  MapVector<Function *, SmallVector<Instruction *, 32>> candidates;
+  for (Value *v: q) {
+    Instruction *i = dyn_cast<Instruction>(v);
+    if (!i || !i->getType()->isFloatingPointTy())
+      continue;
+    if (!isFloatingPointToConvert(i) || valueInfo(i)->isArgumentPlaceholder)
+      continue;
+    candidates[i->getFunction()].push_back(i);
+  }
+
+  for (auto& fcand: candidates) {
+    Function *f = fcand.first;
+    bool coldfun = psi.isFunctionEntryCold(f);
+    BlockFrequencyInfo *bfi = nullptr;
+    if (!coldfun && f->hasProfileData())
+      bfi = &(getAnalysis<BlockFrequencyInfoWrapperPass>(*f).getBFI());
+
+    for (Instruction *i: fcand.second) {
+      if (!coldfun && !(bfi && psi.isColdBlock(i->getParent(), bfi)))
+        continue;
+      LLVM_DEBUG(dbgs() << "value " << *i << " in cold code; leaving it in floating point\n");
+      ColdValueCount++;
+      result.coldValues++;
+      valueInfo(i)->noTypeConversion = true;
+      if (PHINode *phi = dyn_cast<PHINode>(i))
+        demotePhiPlaceholders(phi);
+    }
+  }
+}
+
+
+void FloatToFixed::pruneUnprofitableRegions(std::vector<Value *>& q)
+{
+  if (!options.profitabilityModel)
+    return;
+
+  MapVector<Function *, SmallVector<Instruction *, 32>> candidates;
+  for (Value *v: q) {
+    Instruction *i = dyn_cast<Instruction>(v);
+    if (!i || !i->getType()->isFloatingPointTy())
+      continue;
+    if (!isFloatingPointToConvert(i) || valueInfo(i)->isArgumentPlaceholder)
+      continue;
+    candidates[i->getFunction()].push_back(i);
+  }
+
+  for (auto& fcand: candidates) {
+    Function *f = fcand.first;
+    const TargetTransformInfo& tti = getAnalysis<TargetTransformInfoWrapperPass>().getTTI(*f);
+    /* all the function analyses are recomputed together by each
+     * getAnalysis call, thus they must be retrieved before being used */
+    LoopInfo& li = getAnalysis<LoopInfoWrapperPass>(*f).getLoopInfo();
+    BlockFrequencyInfo *bfi = nullptr;
+    if (f->hasProfileData())
+      bfi = &(getAnalysis<BlockFrequencyInfoWrapperPass>(*f).getBFI());
+    RegionCostModel model(*this, *f, tti, li, bfi);
+
+    /* visit the innermost loops first; the loops left in floating point
+     * become boundaries for the loops containing them */
+    SmallVector<Loop *, 4> loops = li.getLoopsInPreorder();
+    for (auto it = loops.rbegin(); it != loops.rend(); it++) {
+      Loop *loop = *it;
+
+      SmallPtrSet<Value *, 32> region;
+      for (Instruction *i: fcand.second) {
+        if (loop->contains(i) && !valueInfo(i)->noTypeConversion)
+          region.insert(i);
+      }
+      if (region.empty())
+        continue;
+
+      RegionCost cost;
+      for (Value *v: region)
+        model.addInstruction(cast<Instruction>(v), region, cost);
+
+      LLVM_DEBUG(dbgs() << "loop " << loop->getHeader()->getName() << " in " << f->getName()
+                        << ": fixed point cost " << cost.fix << ", floating point cost " << cost.flt << "\n");
+      if (cost.fix <= cost.flt)
+        continue;
+
+      LLVM_DEBUG(dbgs() << "conversion of loop " << loop->getHeader()->getName() << " is unprofitable; "
+                        << region.size() << " values will stay in floating point\n");
+      UnprofitableLoopCount++;
+      result.unprofitableLoops++;
+      for (Value *v: region) {
+        valueInfo(v)->noTypeConversion = true;
+        if (PHINode *phi = dyn_cast<PHINode>(v))
+          demotePhiPlaceholders(phi);
+      }
+    }
+  }
+}
+
+
+/* Drops the converted placeholder of a phi which will not be converted
+ * anymore, as created by openPhiLoop */
+void FloatToFixed::demotePhiPlaceholders(PHINode *phi)
+{
+  auto data = phiReplacementData.find(phi);
+  if (data == phiReplacementData.end())
+    return;
+  PHIInfo& phiinfo = data->second;
+  valueInfo(phiinfo.placeh_noconv)->noTypeConversion = true;
+  if (phiinfo.placeh_conv == phiinfo.placeh_noconv)
+    return;
+
+  LoadInst *placeh = cast<LoadInst>(phiinfo.placeh_conv);
+  Instruction *alloca = cast<Instruction>(placeh->getPointerOperand());
+  info.erase(placeh);
+  placeh->eraseFromParent();
+  alloca->eraseFromParent();
+  phiinfo.placeh_conv = phiinfo.placeh_noconv;
+  operandPool[phiinfo.placeh_noconv] = phiinfo.placeh_noconv;
+}
@@ -0,0 +1,200 @@
+#include "llvm/ADT/Triple.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/InitializePasses.h"
+#include "llvm/PassRegistry.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Support/CommandLine.h"
+#include "LLVMFloatToFixedPass.h"
+#include "FloatToFixedConverter.h"
+
+using namespace llvm;
+using namespace flttofix;
+
+
+static cl::opt<bool> NarrowStorage("fixp-narrow-storage",
+  cl::desc("Store converted arrays in the narrowest format allowed by their range"),
+  cl::init(false));
+static cl::opt<unsigned> NarrowStorageMaxFracLoss("fixp-narrow-storage-max-frac-loss",
+  cl::desc("Maximum amount of fractional bits which can be dropped when storing an array in a narrower format"),
+  cl::init(0));
+static cl::opt<bool> LegalIntermediates("fixp-legal-intermediates",
+  cl::desc("Round the width of intermediate values to the integer widths legal for the target"),
+  cl::init(false));
+static cl::opt<bool> FuseMultiplyAdd("fixp-fuse-mac",
+  cl::desc("Accumulate chains of multiplications and additions in the double-width product format"),
+  cl::init(false));
+static cl::opt<bool> WidenReductions("fixp-widen-reductions",
+  cl::desc("Keep the accumulators of floating point sum reductions in a wider format for the whole loop"),
+  cl::init(false));
+static cl::opt<unsigned> ReductionGuardBits("fixp-reduction-guard-bits",
+  cl::desc("Number of integer guard bits added to widened reduction accumulators"),
+  cl::init(8));
+static cl::opt<unsigned> MaxIndirectTargets("fixp-max-indirect-targets",
+  cl::desc("Maximum number of possible callees for promoting an indirect call to direct calls to converted functions "
+    "(0 = no promotion)"),
+  cl::init(0));
+static cl::opt<bool> RemoveDeadClones("fixp-remove-dead-clones",
+  cl::desc("Delete the original function clones whose uses have all been replaced by converted functions"),
+  cl::init(true));
+static cl::opt<bool> SkipColdCode("fixp-skip-cold",
+  cl::desc("Leave in floating point the functions and the basic blocks which are cold according to the profile"),
+  cl::init(false));
+static cl::opt<bool> EnableProfitabilityModel("fixp-profitability",
+  cl::desc("Leave in floating point the loops whose conversion to fixed point is estimated unprofitable"),
+  cl::init(false));
+static cl::opt<bool> PackStructs("fixp-pack-structs",
+  cl::desc("Reorder the fields of converted structs which do not escape to unconverted code to reduce their size"),
+  cl::init(false));
+static cl::opt<bool> MergeConstantGlobals("fixp-merge-constant-globals",
+  cl::desc("Share the storage of converted constant globals with identical contents"),
+  cl::init(true));
+static cl::opt<unsigned> ConstantConversionThreads("fixp-constant-conversion-threads",
+  cl::desc("Number of threads used for converting large constant arrays (0 = one per hardware thread)"),
+  cl::init(1));
+static cl::opt<bool> InstrumentConversions("fixp-instrument-conversions",
+  cl::desc("Count the executions of every conversion inserted by the pass at runtime "
+    "(requires linking the taffo conversion counters runtime)"),
+  cl::init(false));
+static cl::opt<bool> ProfileRanges("fixp-profile-ranges",
+  cl::desc("Instead of converting the module, instrument the floating point values with a range "
+    "to record their actual minimum and maximum at runtime (requires linking the taffo range profile runtime)"),
+  cl::init(false));
+
+
+FloatToFixedOptions FloatToFixedOptions::fromCommandLine()
+{
+  FloatToFixedOptions res;
+  res.narrowStorage = NarrowStorage;
+  res.narrowStorageMaxFracLoss = NarrowStorageMaxFracLoss;
+  res.legalIntermediates = LegalIntermediates;
+  res.fuseMultiplyAdd = FuseMultiplyAdd;
+  res.widenReductions = WidenReductions;
+  res.reductionGuardBits = ReductionGuardBits;
+  res.maxIndirectTargets = MaxIndirectTargets;
+  res.removeDeadClones = RemoveDeadClones;
+  res.skipColdCode = SkipColdCode;
+  res.profitabilityModel = EnableProfitabilityModel;
+  res.packStructs = PackStructs;
+  res.mergeConstantGlobals = MergeConstantGlobals;
+  res.constantConversionThreads = ConstantConversionThreads;
+  res.instrumentConversions = InstrumentConversions;
+  res.profileRanges = ProfileRanges;
+  return res;
+}
+
+
+FloatToFixedConverter::FloatToFixedConverter(const FloatToFixedOptions& options, TargetIRAnalysis tira):
+  options(options), tira(std::move(tira))
+{
+  /* the analyses required by the pass are registered by opt, but not
+   * necessarily in the programs which use the library */
+  PassRegistry& registry = *PassRegistry::getPassRegistry();
+  initializeCore(registry);
+  initializeAnalysis(registry);
+}
+
+
+ConversionResult FloatToFixedConverter::convert(Module& m) const
+{
+  legacy::PassManager pm;
+  pm.add(new TargetLibraryInfoWrapperPass(Triple(m.getTargetTriple())));
+  pm.add(createTargetTransformInfoWrapperPass(tira));
+  /* owned by the pass manager */
+  FloatToFixed *pass = new FloatToFixed(options);
+  pm.add(pass);
+  pm.run(m);
+  return pass->result;
+}
+
+
+/* Returns if the type of a value of type t may change in the conversion */
+static bool mayContainFloat(Type *t, SmallPtrSetImpl<Type *>& visited)
+{
+  if (t->isFloatingPointTy())
+    return true;
+  /* recursive structs */
+  if (!visited.insert(t).second)
+    return false;
+  for (Type *sub: t->subtypes()) {
+    if (mayContainFloat(sub, visited))
+      return true;
+  }
+  return false;
+}
+
+
+/* Adds to res the global values used by the constant c */
+static void collectGlobals(Constant *c, SmallPtrSetImpl<Constant *>& visited, SmallVectorImpl<GlobalValue *>& res)
+{
+  if (!visited.insert(c).second)
+    return;
+  if (GlobalValue *gv = dyn_cast<GlobalValue>(c)) {
+    res.push_back(gv);
+    return;
+  }
+  for (Value *op: c->operands())
+    collectGlobals(cast<Constant>(op), visited, res);
+}
+
+
+/* Adds to res the functions and global values whose definition uses v,
+ * also through constant expressions */
+static void collectUsers(Value *v, SmallVectorImpl<GlobalValue *>& res)
+{
+  for (User *u: v->users()) {
+    if (Instruction *i = dyn_cast<Instruction>(u))
+      res.push_back(i->getFunction());
+    else if (GlobalValue *gv = dyn_cast<GlobalValue>(u))
+      res.push_back(gv);
+    else if (isa<Constant>(u))
+      collectUsers(u, res);
+  }
+}
+
+
+void flttofix::addConversionDependencies(Module& m, SmallPtrSetImpl<GlobalValue *>& defs)
+{
+  SmallVector<GlobalValue *, 16> worklist(defs.begin(), defs.end());
+  SmallPtrSet<Constant *, 32> visited;
+
+  while (!worklist.empty()) {
+    GlobalValue *gv = worklist.pop_back_val();
+    SmallVector<GlobalValue *, 16> deps;
+    SmallPtrSet<Type *, 8> visitedTypes;
+
+    if (Function *f = dyn_cast<Function>(gv)) {
+      for (Instruction& i: instructions(f)) {
+        for (Value *op: i.operands()) {
+          if (Constant *c = dyn_cast<Constant>(op))
+            collectGlobals(c, visited, deps);
+        }
+      }
+      if (f->hasPersonalityFn())
+        collectGlobals(f->getPersonalityFn(), visited, deps);
+      /* the calls to the clones are converted at the call site, which needs
+       * the body of the clone */
+      if (f->getMetadata(SOURCE_FUN_METADATA))
+        collectUsers(f, deps);
+    } else if (GlobalVariable *var = dyn_cast<GlobalVariable>(gv)) {
+      if (var->hasInitializer())
+        collectGlobals(var->getInitializer(), visited, deps);
+      /* its type may change, so all the code using it is converted together */
+      if (mayContainFloat(var->getValueType(), visitedTypes))
+        collectUsers(var, deps);
+    } else if (GlobalAlias *alias = dyn_cast<GlobalAlias>(gv)) {
+      collectGlobals(alias->getAliasee(), visited, deps);
+    }
+    for (GlobalAlias& alias: m.aliases()) {
+      if (alias.getBaseObject() == gv)
+        deps.push_back(&alias);
+    }
+
+    for (GlobalValue *dep: deps) {
+      if (!dep->isDeclaration() && defs.insert(dep).second)
+        worklist.push_back(dep);
+    }
+  }
+}
@@ -0,0 +1,149 @@
+#include <string>
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+
+
+#ifndef __FLOAT_TO_FIXED_CONVERTER_H__
+#define __FLOAT_TO_FIXED_CONVERTER_H__
+
+
+namespace flttofix {
+
+
+/** Options of the float to fixed point conversion.
+ *  The defaults are the same as the ones of the command line options of
+ *  the flttofix pass, which are given in brackets. */
+struct FloatToFixedOptions {
+  /** Store converted arrays in the narrowest format allowed by their
+   *  range [-fixp-narrow-storage] */
+  bool narrowStorage = false;
+  /** Maximum amount of fractional bits which can be dropped when storing
+   *  an array in a narrower format [-fixp-narrow-storage-max-frac-loss] */
+  unsigned narrowStorageMaxFracLoss = 0;
+  /** Round the width of intermediate values to the integer widths legal
+   *  for the target [-fixp-legal-intermediates] */
+  bool legalIntermediates = false;
+  /** Accumulate products without intermediate normalization
+   *  [-fixp-fuse-mac] */
+  bool fuseMultiplyAdd = false;
+  /** Keep the accumulators of sum reductions in a wider format for the
+   *  whole loop, when the wider integer is native to the target
+   *  [-fixp-widen-reductions] */
+  bool widenReductions = false;
+  /** Integer guard bits added to widened reduction accumulators
+   *  [-fixp-reduction-guard-bits] */
+  unsigned reductionGuardBits = 8;
+  /** Maximum number of possible callees for promoting an indirect call;
+   *  0 disables the promotion [-fixp-max-indirect-targets] */
+  unsigned maxIndirectTargets = 0;
+  /** Delete the original function clones which are no longer used
+   *  [-fixp-remove-dead-clones] */
+  bool removeDeadClones = true;
+  /** Leave cold code in floating point [-fixp-skip-cold] */
+  bool skipColdCode = false;
+  /** Leave in floating point the loops whose conversion is estimated
+   *  unprofitable [-fixp-profitability] */
+  bool profitabilityModel = false;
+  /** Reorder the fields of the converted structs to reduce padding
+   *  [-fixp-pack-structs] */
+  bool packStructs = false;
+  /** Share the storage of identical converted constant globals
+   *  [-fixp-merge-constant-globals] */
+  bool mergeConstantGlobals = true;
+  /** Threads used for converting large constant arrays; 0 for one per
+   *  hardware thread [-fixp-constant-conversion-threads] */
+  unsigned constantConversionThreads = 1;
+  /** Count the executions of every inserted conversion at runtime
+   *  [-fixp-instrument-conversions] */
+  bool instrumentConversions = false;
+  /** Instrument the ranges of the values instead of converting the
+   *  module [-fixp-profile-ranges] */
+  bool profileRanges = false;
+  /** File where the converted instructions are listed; empty for no file.
+   *  Concurrent conversions must use different files.
+   *  [-fixp-conversion-log, only for the flttofix pass created by opt] */
+  std::string conversionLog;
+
+  /** Returns the options given on the command line (or their defaults if
+   *  the command line was not parsed), except the conversion log. */
+  static FloatToFixedOptions fromCommandLine();
+};
+
+
+/** Summary of a conversion */
+struct ConversionResult {
+  /** Whether the module was modified */
+  bool changed = false;
+  /** Values with valid conversion metadata */
+  unsigned metadataValues = 0;
+  /** Values in the conversion queue */
+  unsigned queuedValues = 0;
+  /** Values whose conversion failed */
+  unsigned conversionErrors = 0;
+  /** Floating point to fixed point conversions inserted */
+  unsigned floatToFixConversions = 0;
+  /** Fixed point to floating point conversions inserted */
+  unsigned fixToFloatConversions = 0;
+  /** Instructions not replaced by a fixed point equivalent */
+  unsigned fallbacks = 0;
+  /** Fixed point functions created */
+  unsigned functionsCreated = 0;
+  unsigned fusedMACs = 0;
+  unsigned widenedReductions = 0;
+  unsigned promotedIndirectCalls = 0;
+  unsigned narrowStorageArrays = 0;
+  unsigned packedStructs = 0;
+  /** Values left in floating point because they are in cold code */
+  unsigned coldValues = 0;
+  /** Loops left in floating point because their conversion is not
+   *  profitable */
+  unsigned unprofitableLoops = 0;
+  /** Values instrumented with -fixp-profile-ranges */
+  unsigned profiledValues = 0;
+  unsigned literalCacheHits = 0;
+  unsigned mergedConstantGlobals = 0;
+  /** Dead original instructions removed */
+  unsigned deadInstructions = 0;
+  /** Dead original function clones removed */
+  unsigned deadClones = 0;
+};
+
+
+/** Converts in memory modules processed by the TAFFO analyses, without
+ *  going through opt.
+ *  Every call to convert() uses a new instance of the pass, so a converter
+ *  can be shared by several threads converting modules which belong to
+ *  different contexts. */
+class FloatToFixedConverter {
+public:
+  /** @param tira Analysis of the target, for the profitability model and
+   *    the legal integer widths; the default one has no target information. */
+  explicit FloatToFixedConverter(const FloatToFixedOptions& options = FloatToFixedOptions::fromCommandLine(),
+    llvm::TargetIRAnalysis tira = llvm::TargetIRAnalysis());
+
+  const FloatToFixedOptions& getOptions() const { return options; }
+
+  /** Converts in place a module with the TAFFO metadata */
+  ConversionResult convert(llvm::Module& m) const;
+
+private:
+  FloatToFixedOptions options;
+  llvm::TargetIRAnalysis tira;
+};
+
+
+/** Adds to defs the definitions of m which must be converted in the same
+ *  module as the ones it already contains, when the definitions of a module
+ *  are converted in separate parts: the global values they reference, the
+ *  callers of the function clones, which are converted at the call site,
+ *  and all the users of the global variables which may contain floating
+ *  point values, whose type may change. The aliases of every definition are
+ *  added too. */
+void addConversionDependencies(llvm::Module& m, llvm::SmallPtrSetImpl<llvm::GlobalValue *>& defs);
+
+
+}
+
+
+#endif
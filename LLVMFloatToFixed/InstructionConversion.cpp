@@ -8,11 +8,15 @@
 #include "llvm/IR/InstIterator.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/InstrTypes.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/APSInt.h"
 #include "llvm/ADT/APFloat.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Analysis/LoopInfo.h"
 #include "LLVMFloatToFixedPass.h"
 #include "TypeUtils.h"
 
@@ -23,6 +27,16 @@ using namespace taffo;
 #define defaultFixpType @SYNTAX_ERROR@
 
 
+/* Returns if a call is to llvm.fmuladd or llvm.fma */
+static bool isMulAddIntrinsic(Value *v)
+{
+  IntrinsicInst *ii = dyn_cast<IntrinsicInst>(v);
+  if (!ii)
+    return false;
+  return ii->getIntrinsicID() == Intrinsic::fmuladd || ii->getIntrinsicID() == Intrinsic::fma;
+}
+
+
 /* also inserts the new value in the basic blocks, alongside the old one */
 Value *FloatToFixed::convertInstruction(Module& m, Instruction *val, FixedPointType& fixpt)
 {
@@ -89,18 +103,30 @@ Value *FloatToFixed::convertInstruction(Module& m, Instruction *val, FixedPointT
 }
 
 
-Value *FloatToFixed::convertAlloca(AllocaInst *alloca, const FixedPointType& fixpt)
+Value *FloatToFixed::convertAlloca(AllocaInst *alloca, FixedPointType& fixpt)
 {
   if (valueInfo(alloca)->noTypeConversion)
     return alloca;
   
+  FixedPointType storaget;
+  if (getNarrowStorageType(alloca, fixpt, storaget)) {
+    LLVM_DEBUG(dbgs() << "storing " << *alloca << " as " << storaget << " instead of " << fixpt << "\n");
+    fixpt = storaget;
+    valueInfo(alloca)->isNarrowStorage = true;
+    NarrowStorageCount++;
+    result.narrowStorageArrays++;
+  }
+  
   Type *prevt = alloca->getAllocatedType();
   Type *newt = getLLVMFixedPointTypeForFloatType(prevt, fixpt);
   if (newt == prevt)
     return alloca;
 
   Value *as = alloca->getArraySize();
-  MaybeAlign alignment(alloca->getAlignment());
+  unsigned align = alloca->getAlignment();
+  if (valueInfo(alloca)->isNarrowStorage)
+    align = getVectorFriendlyAlignment(newt, alloca->getFunction(), align);
+  MaybeAlign alignment(align);
   AllocaInst *newinst = new AllocaInst(newt, alloca->getType()->getPointerAddressSpace(), as, alignment);
   
   newinst->setUsedWithInAlloca(alloca->isUsedWithInAlloca());
@@ -120,8 +146,6 @@ Value *FloatToFixed::convertLoad(LoadInst *load, FixedPointType& fixpt)
     return Unsupported;
   
   if (isConvertedFixedPoint(newptr)) {
-    fixpt = fixPType(newptr);
-
     MaybeAlign alignment(load->getAlignment());
     LoadInst *newinst = new LoadInst(newptr, Twine(), load->isVolatile(),
       alignment, load->getOrdering(), load->getSyncScopeID());
@@ -130,6 +154,11 @@ Value *FloatToFixed::convertLoad(LoadInst *load, FixedPointType& fixpt)
       assert(newinst->getType()->isIntegerTy() && "DTA bug; improperly tagged struct/pointer!");
       return genConvertFixToFloat(newinst, fixPType(newptr), load->getType());
     }
+    if (valueInfo(newptr)->isNarrowStorage && newinst->getType()->isIntegerTy() && !fixpt.isInvalid()) {
+      /* widen the value back to the format used for computation */
+      return genConvertFixedToFixed(newinst, fixPType(newptr), fixpt);
+    }
+    fixpt = fixPType(newptr);
     return newinst;
   }
   
@@ -225,6 +254,7 @@ Value *FloatToFixed::convertGep(GetElementPtrInst *gep, FixedPointType& fixpt)
 
   Type *type = gep->getPointerOperand()->getType();
   fixpt = tempFixpt.unwrapIndexList(type, gep->indices());
+  valueInfo(gep)->isNarrowStorage = valueInfo(newval)->isNarrowStorage;
   
   /* if conversion is disabled, we can extract values that didn't get a type change,
    * but we cannot extract values that didn't */
@@ -232,6 +262,7 @@ Value *FloatToFixed::convertGep(GetElementPtrInst *gep, FixedPointType& fixpt)
     return Unsupported;
 
   std::vector<Value*> idxlist(gep->indices().begin(), gep->indices().end());
+  remapGEPIndices(newval->getType(), idxlist);
   return builder.CreateInBoundsGEP(newval, idxlist);
 }
 
@@ -251,6 +282,7 @@ Value *FloatToFixed::convertExtractValue(ExtractValueInst *exv, FixedPointType&
   FixedPointType baset = fixPType(newval).unwrapIndexList(oldval->getType(), exv->getIndices());
 
   std::vector<unsigned> idxlist(exv->indices().begin(), exv->indices().end());
+  remapAggregateIndices(newval->getType(), idxlist);
   Value *newi = builder.CreateExtractValue(newval, idxlist);
   if (!baset.isInvalid() && newi->getType()->isIntegerTy())
     return genConvertFixedToFixed(newi, baset, fixpt);
@@ -284,6 +316,7 @@ Value *FloatToFixed::convertInsertValue(InsertValueInst *inv, FixedPointType& fi
   
   fixpt = fixPType(newAggVal);
   std::vector<unsigned> idxlist(inv->indices().begin(), inv->indices().end());
+  remapAggregateIndices(newAggVal->getType(), idxlist);
   return builder.CreateInsertValue(newAggVal, newInsertVal, idxlist);
 }
 
@@ -316,17 +349,29 @@ Value *FloatToFixed::convertPhi(PHINode *phi, FixedPointType& fixpt)
   PHINode *newphi = PHINode::Create(fixpt.scalarToLLVMType(phi->getContext()),
     phi->getNumIncomingValues());
 
+  /* the conversions of the incoming values are placed on the incoming edges,
+   * or in a loop preheader when the value comes from outside the loop */
+  SmallVector<BasicBlock *, 4> convbbs;
+  getPhiIncomingConversionBlocks(phi, fixpt, convbbs);
+
   for (int i=0; i<phi->getNumIncomingValues(); i++) {
     Value *thisval = phi->getIncomingValue(i);
     BasicBlock *thisbb = phi->getIncomingBlock(i);
-    Value *newval = translateOrMatchOperandAndType(thisval, fixpt, thisbb->getTerminator());
-    if (!newval) {
-      delete newphi;
-      return nullptr;
-    }
-    Instruction *inst2 = dyn_cast<Instruction>(newval);
-    if (inst2) {
-      LLVM_DEBUG(dbgs() << "warning: new phi value " << *inst2 << " not coming from the obviously correct BB\n");
+    BasicBlock *convbb = convbbs[i] ? convbbs[i] : thisbb;
+    
+    /* phis taking the same value from the same edge share the conversion */
+    auto key = std::make_tuple(thisval, convbb, fixpt.toString());
+    Value *newval;
+    auto cached = phiIncomingConversions.find(key);
+    if (cached != phiIncomingConversions.end()) {
+      newval = cached->second;
+    } else {
+      newval = translateOrMatchOperandAndType(thisval, fixpt, convbb->getTerminator());
+      if (!newval) {
+        delete newphi;
+        return nullptr;
+      }
+      phiIncomingConversions[key] = newval;
     }
     newphi->addIncoming(newval, thisbb);
   }
@@ -335,6 +380,96 @@ Value *FloatToFixed::convertPhi(PHINode *phi, FixedPointType& fixpt)
 }
 
 
+bool FloatToFixed::needsConversionCode(Value *val, const FixedPointType& fixpt)
+{
+  if (isa<Constant>(val))
+    return false;
+  Value *res = operandPool[val];
+  if (!res || res == ConversionError || !hasInfo(val) || valueInfo(val)->noTypeConversion)
+    return true;
+  return !(fixPType(res) == fixpt);
+}
+
+
+void FloatToFixed::getPhiIncomingConversionBlocks(PHINode *phi, const FixedPointType& fixpt, SmallVectorImpl<BasicBlock *>& res)
+{
+  BasicBlock *phibb = phi->getParent();
+  res.assign(phi->getNumIncomingValues(), nullptr);
+  
+  /* the loop nest was recorded before any edge was split; the blocks
+   * created since then are not in it */
+  const LoopNest& nest = getLoopNest(phibb->getParent());
+  auto philoop = nest.innermost.find(phibb);
+  SmallVector<bool, 4> hoisted(phi->getNumIncomingValues(), false);
+  for (unsigned i = 0; philoop != nest.innermost.end() && i < phi->getNumIncomingValues(); i++) {
+    Value *thisval = phi->getIncomingValue(i);
+    if (!needsConversionCode(thisval, fixpt) || isa<InvokeInst>(thisval))
+      continue;
+    
+    /* the loops which contain the value */
+    SmallSet<int, 4> defloops;
+    if (Instruction *def = dyn_cast<Instruction>(thisval)) {
+      auto defloop = nest.innermost.find(def->getParent());
+      if (defloop == nest.innermost.end())
+        continue;
+      for (int l = defloop->second; l >= 0; l = nest.loops[l].first)
+        defloops.insert(l);
+    }
+    
+    /* find the outermost loop which contains the phi but not the value */
+    int outer = -1;
+    for (int l = philoop->second; l >= 0; l = nest.loops[l].first) {
+      if (defloops.count(l))
+        break;
+      outer = l;
+    }
+    if (outer < 0)
+      continue;
+    BasicBlock *preheader = nest.loops[outer].second;
+    if (!preheader)
+      continue;
+    /* the value dominates the incoming edge, thus it also dominates the
+     * preheader of any loop not containing it */
+    res[i] = preheader;
+    hoisted[i] = true;
+  }
+  
+  for (unsigned i = 0; i < phi->getNumIncomingValues(); i++) {
+    if (hoisted[i] || !needsConversionCode(phi->getIncomingValue(i), fixpt))
+      continue;
+    BasicBlock *thisbb = phi->getIncomingBlock(i);
+    Instruction *term = thisbb->getTerminator();
+    if (term->getNumSuccessors() <= 1) {
+      res[i] = thisbb;
+      continue;
+    }
+    
+    unsigned succidx = 0, nsucc = 0;
+    for (unsigned j = 0; j < term->getNumSuccessors(); j++) {
+      if (term->getSuccessor(j) == phibb) {
+        succidx = j;
+        nsucc++;
+      }
+    }
+    /* SplitCriticalEdge does not update all the phi entries when the
+     * same edge appears more than once */
+    if (nsucc != 1) {
+      res[i] = thisbb;
+      continue;
+    }
+    
+    BasicBlock *newbb = SplitCriticalEdge(term, succidx);
+    if (newbb) {
+      LLVM_DEBUG(dbgs() << "split critical edge " << thisbb->getName() << " -> " << phibb->getName() << " for the conversions of " << *phi << "\n");
+      /* the phi now receives the value from the new block */
+      res[i] = newbb;
+    } else {
+      res[i] = thisbb;
+    }
+  }
+}
+
+
 Value *FloatToFixed::convertSelect(SelectInst *sel, FixedPointType& fixpt)
 {
   if (!isFloatingPointToConvert(sel))
@@ -361,6 +496,15 @@ Value *FloatToFixed::convertCall(CallSite *call, FixedPointType& fixpt)
    * otherwise the return type is left unchanged.*/
   Function *oldF = call->getCalledFunction();
 
+  if (isMulAddIntrinsic(call->getInstruction()))
+    return convertMulAddIntrinsic(call->getInstruction(), fixpt);
+  if (MemIntrinsic *memi = dyn_cast<MemIntrinsic>(call->getInstruction()))
+    return convertMemIntrinsic(memi);
+  if (!oldF) {
+    /* calls through pointers to functions which could not be promoted */
+    LLVM_DEBUG(dbgs() << "[Info] indirect call " << *(call->getInstruction()) << ", engaging fallback\n");
+    return Unsupported;
+  }
   if (isSpecialFunction(oldF))
     return Unsupported;
   
@@ -484,6 +628,11 @@ Value *FloatToFixed::convertBinOp(Instruction *instr, const FixedPointType& fixp
   
   int opc = instr->getOpcode();
 
+  if (opc == Instruction::FAdd || opc == Instruction::FSub) {
+    if (Value *res = convertFusedAdd(instr, fixpt))
+      return res;
+  }
+  
   if (opc == Instruction::FAdd || opc == Instruction::FSub || opc == Instruction::FRem) {
     Value *val1 = translateOrMatchOperandAndType(instr->getOperand(0), fixpt, instr);
     Value *val2 = translateOrMatchOperandAndType(instr->getOperand(1), fixpt, instr);
@@ -512,27 +661,14 @@ Value *FloatToFixed::convertBinOp(Instruction *instr, const FixedPointType& fixp
     return fixop;
 
   } else if (opc == Instruction::FMul) {
-    FixedPointType intype1 = fixpt, intype2 = fixpt;
-    Value *val1 = translateOrMatchOperand(instr->getOperand(0), intype1, instr, TypeMatchPolicy::RangeOverHintMaxInt);
-    Value *val2 = translateOrMatchOperand(instr->getOperand(1), intype2, instr, TypeMatchPolicy::RangeOverHintMaxInt);
-    if (!val1 || !val2)
+    FixedPointType intermtype;
+    Value *fixop = genFixedPointWideMul(instr->getOperand(0), instr->getOperand(1), fixpt, instr, intermtype);
+    if (!fixop)
       return nullptr;
-    FixedPointType intermtype(
-      fixpt.scalarIsSigned(),
-      intype1.scalarFracBitsAmt() + intype2.scalarFracBitsAmt(),
-      intype1.scalarBitsAmt() + intype2.scalarBitsAmt());
-    Type *dbfxt = intermtype.scalarToLLVMType(instr->getContext());
-    
-    IRBuilder<> builder(instr);
-    Value *ext1 = intype1.scalarIsSigned() ? builder.CreateSExt(val1, dbfxt) : builder.CreateZExt(val1, dbfxt);
-    Value *ext2 = intype2.scalarIsSigned() ? builder.CreateSExt(val2, dbfxt) : builder.CreateZExt(val2, dbfxt);
-    Value *fixop = builder.CreateMul(ext1, ext2);
-    cpMetaData(ext1,val1);
-    cpMetaData(ext2,val2);
-    cpMetaData(fixop,instr);
     updateFPTypeMetadata(fixop, intermtype.scalarIsSigned(), intermtype.scalarFracBitsAmt(), intermtype.scalarBitsAmt());
-    updateConstTypeMetadata(fixop, 0U, intype1);
-    updateConstTypeMetadata(fixop, 1U, intype2);
+    if (isFusableIntoAdd(instr))
+      /* the addition will consume the product before normalization */
+      wideValues[instr] = std::make_pair(fixop, intermtype);
     return genConvertFixedToFixed(fixop, intermtype, fixpt, instr);
     
   } else if (opc == Instruction::FDiv) {
@@ -542,16 +678,21 @@ Value *FloatToFixed::convertBinOp(Instruction *instr, const FixedPointType& fixp
     Value *val2 = translateOrMatchOperand(instr->getOperand(1), intype2, instr, TypeMatchPolicy::RangeOverHintMaxInt);
     if (!val1 || !val2)
       return nullptr;
+    /* the bits added by rounding to a legal width become additional
+     * fractional bits of the quotient */
+    int bits = intype1.scalarBitsAmt() + intype2.scalarBitsAmt();
+    int legalbits = getLegalIntegerWidth(bits, instr->getFunction());
+    int extrafrac = legalbits - bits;
     FixedPointType intermtype(
       fixpt.scalarIsSigned(),
-      intype1.scalarFracBitsAmt() + intype2.scalarFracBitsAmt(),
-      intype1.scalarBitsAmt() + intype2.scalarBitsAmt());
+      intype1.scalarFracBitsAmt() + intype2.scalarFracBitsAmt() + extrafrac,
+      legalbits);
     Type *dbfxt = intermtype.scalarToLLVMType(instr->getContext());
     
     FixedPointType fixoptype(
       fixpt.scalarIsSigned(),
-      intype1.scalarFracBitsAmt(),
-      intype1.scalarBitsAmt() + intype2.scalarBitsAmt());
+      intype1.scalarFracBitsAmt() + extrafrac,
+      legalbits);
     Value *ext1 = genConvertFixedToFixed(val1, intype1, intermtype, instr);
     IRBuilder<> builder(instr);
     Value *ext2 = intype2.scalarIsSigned() ? builder.CreateSExt(val2, dbfxt) : builder.CreateZExt(val2, dbfxt);
@@ -569,11 +710,274 @@ Value *FloatToFixed::convertBinOp(Instruction *instr, const FixedPointType& fixp
 }
 
 
+bool FloatToFixed::isFusableIntoAdd(Instruction *instr)
+{
+  if (!options.fuseMultiplyAdd || !instr->hasOneUse())
+    return false;
+  Use& use = *(instr->use_begin());
+  Instruction *user = dyn_cast<Instruction>(use.getUser());
+  if (!user)
+    return false;
+  bool isadd = user->getOpcode() == Instruction::FAdd || user->getOpcode() == Instruction::FSub;
+  bool isaddend = isMulAddIntrinsic(user) && use.getOperandNo() == 2;
+  if (!isadd && !isaddend)
+    return false;
+  return hasInfo(user) && !valueInfo(user)->noTypeConversion;
+}
+
+
+Value *FloatToFixed::genFixedPointWideMul(Value *op1, Value *op2, const FixedPointType& fixpt, Instruction *ip, FixedPointType& prodtype)
+{
+  FixedPointType intype1 = fixpt, intype2 = fixpt;
+  Value *val1 = translateOrMatchOperand(op1, intype1, ip, TypeMatchPolicy::RangeOverHintMaxInt);
+  Value *val2 = translateOrMatchOperand(op2, intype2, ip, TypeMatchPolicy::RangeOverHintMaxInt);
+  if (!val1 || !val2)
+    return nullptr;
+  /* the product is exact, so a wider legal type only adds integer bits */
+  prodtype = FixedPointType(
+    fixpt.scalarIsSigned(),
+    intype1.scalarFracBitsAmt() + intype2.scalarFracBitsAmt(),
+    getLegalIntegerWidth(intype1.scalarBitsAmt() + intype2.scalarBitsAmt(), ip->getFunction()));
+  Type *dbfxt = prodtype.scalarToLLVMType(ip->getContext());
+  
+  IRBuilder<> builder(ip);
+  Value *ext1 = intype1.scalarIsSigned() ? builder.CreateSExt(val1, dbfxt) : builder.CreateZExt(val1, dbfxt);
+  Value *ext2 = intype2.scalarIsSigned() ? builder.CreateSExt(val2, dbfxt) : builder.CreateZExt(val2, dbfxt);
+  Value *fixop = builder.CreateMul(ext1, ext2);
+  cpMetaData(ext1,val1);
+  cpMetaData(ext2,val2);
+  cpMetaData(fixop,ip);
+  updateConstTypeMetadata(fixop, 0U, intype1);
+  updateConstTypeMetadata(fixop, 1U, intype2);
+  return fixop;
+}
+
+
+Value *FloatToFixed::genFixedPointWideAdd(Value *val1, const FixedPointType& type1, Value *val2, const FixedPointType& type2,
+  bool sub, const FixedPointType& fixpt, Instruction *ip, FixedPointType& sumtype)
+{
+  /* the sum keeps all the fractional bits of the terms, with one more
+   * integer bit for the carry; an unsigned term in a signed sum also needs
+   * a bit for the sign */
+  bool sign = fixpt.scalarIsSigned() || type1.scalarIsSigned() || type2.scalarIsSigned();
+  auto intBitsIn = [sign](const FixedPointType& t) -> int {
+    int intbits = t.scalarBitsAmt() - t.scalarFracBitsAmt();
+    return sign && !t.scalarIsSigned() ? intbits + 1 : intbits;
+  };
+  int frac = std::max(type1.scalarFracBitsAmt(), type2.scalarFracBitsAmt());
+  int intbits = std::max(intBitsIn(type1), intBitsIn(type2)) + 1;
+  if (intbits + frac > 64)
+    frac = 64 - intbits;
+  if (frac < fixpt.scalarFracBitsAmt())
+    return nullptr;
+  int bits = getLegalIntegerWidth(intbits + frac, ip->getFunction());
+  if (bits > 64)
+    bits = intbits + frac;
+  sumtype = FixedPointType(sign, frac, bits);
+  
+  val1 = genConvertFixedToFixed(val1, type1, sumtype, ip);
+  val2 = genConvertFixedToFixed(val2, type2, sumtype, ip);
+  IRBuilder<> builder(ip);
+  return sub ? builder.CreateSub(val1, val2) : builder.CreateAdd(val1, val2);
+}
+
+
+Value *FloatToFixed::convertFusedAdd(Instruction *instr, const FixedPointType& fixpt)
+{
+  Value *op[2] = {instr->getOperand(0), instr->getOperand(1)};
+  Value *val[2];
+  FixedPointType type[2];
+  bool haswide = false;
+  
+  for (int i=0; i<2; i++) {
+    auto wide = wideValues.find(op[i]);
+    if (wide != wideValues.end()) {
+      val[i] = wide->second.first;
+      type[i] = wide->second.second;
+      haswide = true;
+    } else {
+      val[i] = nullptr;
+      type[i] = fixpt;
+    }
+  }
+  if (!haswide)
+    return nullptr;
+  
+  for (int i=0; i<2; i++) {
+    if (!val[i]) {
+      val[i] = translateOrMatchOperandAndType(op[i], fixpt, instr);
+      if (!val[i])
+        return nullptr;
+    }
+  }
+  
+  FixedPointType sumtype;
+  Value *fixop = genFixedPointWideAdd(val[0], type[0], val[1], type[1],
+    instr->getOpcode() == Instruction::FSub, fixpt, instr, sumtype);
+  if (!fixop)
+    return nullptr;
+  cpMetaData(fixop, instr);
+  updateFPTypeMetadata(fixop, sumtype.scalarIsSigned(), sumtype.scalarFracBitsAmt(), sumtype.scalarBitsAmt());
+  LLVM_DEBUG(dbgs() << "fused " << *instr << " into " << *fixop << " with type " << sumtype << "\n");
+  FusedMACCount++;
+  result.fusedMACs++;
+  
+  if (isFusableIntoAdd(instr))
+    wideValues[instr] = std::make_pair(fixop, sumtype);
+  return genConvertFixedToFixed(fixop, sumtype, fixpt, instr);
+}
+
+
+Value *FloatToFixed::convertMulAddIntrinsic(Instruction *call, const FixedPointType& fixpt)
+{
+  if (!call->getType()->isFloatingPointTy() || valueInfo(call)->noTypeConversion)
+    return Unsupported;
+  
+  FixedPointType prodtype;
+  Value *prod = genFixedPointWideMul(call->getOperand(0), call->getOperand(1), fixpt, call, prodtype);
+  if (!prod)
+    return nullptr;
+  
+  Value *addend = call->getOperand(2);
+  Value *newaddend;
+  FixedPointType addendtype = fixpt;
+  auto wide = wideValues.find(addend);
+  if (wide != wideValues.end()) {
+    newaddend = wide->second.first;
+    addendtype = wide->second.second;
+  } else {
+    newaddend = translateOrMatchOperandAndType(addend, fixpt, call);
+    if (!newaddend)
+      return nullptr;
+  }
+  
+  FixedPointType sumtype;
+  Value *fixop = genFixedPointWideAdd(prod, prodtype, newaddend, addendtype, false, fixpt, call, sumtype);
+  if (!fixop) {
+    /* the product format is too wide for a single accumulation; add
+     * in the format of the result */
+    Value *normprod = genConvertFixedToFixed(prod, prodtype, fixpt, call);
+    Value *normaddend = genConvertFixedToFixed(newaddend, addendtype, fixpt, call);
+    IRBuilder<> builder(call);
+    return cpMetaData(builder.CreateAdd(normprod, normaddend), call);
+  }
+  cpMetaData(fixop, call);
+  updateFPTypeMetadata(fixop, sumtype.scalarIsSigned(), sumtype.scalarFracBitsAmt(), sumtype.scalarBitsAmt());
+  LLVM_DEBUG(dbgs() << "converted " << *call << " into " << *fixop << " with type " << sumtype << "\n");
+  FusedMACCount++;
+  result.fusedMACs++;
+  
+  if (isFusableIntoAdd(call))
+    wideValues[call] = std::make_pair(fixop, sumtype);
+  return genConvertFixedToFixed(fixop, sumtype, fixpt, call);
+}
+
+
+bool FloatToFixed::matchMemIntrinsicPointer(Value *ptr, Value *&newptr, Type *&oldelemt, Type *&newelemt)
+{
+  Value *base = ptr->stripPointerCasts();
+  newptr = matchOp(base);
+  if (!newptr)
+    return false;
+  if (!isConvertedFixedPoint(newptr)) {
+    newptr = nullptr;
+    return true;
+  }
+  oldelemt = fullyUnwrapPointerOrArrayType(valueInfo(newptr)->origType);
+  newelemt = fullyUnwrapPointerOrArrayType(newptr->getType());
+  return true;
+}
+
+
+Value *FloatToFixed::convertMemIntrinsic(MemIntrinsic *memi)
+{
+  Value *newdest, *newsrc = nullptr;
+  Type *oldelemt = nullptr, *newelemt = nullptr;
+  if (!matchMemIntrinsicPointer(memi->getRawDest(), newdest, oldelemt, newelemt))
+    return nullptr;
+  
+  MemTransferInst *memt = dyn_cast<MemTransferInst>(memi);
+  if (memt) {
+    Type *srcoldelemt = nullptr, *srcnewelemt = nullptr;
+    if (!matchMemIntrinsicPointer(memt->getRawSource(), newsrc, srcoldelemt, srcnewelemt))
+      return nullptr;
+    if (!newdest && !newsrc)
+      return Unsupported;
+    /* a bulk copy requires both buffers to be in the same format */
+    if (!newdest || !newsrc || srcnewelemt != newelemt ||
+        !(fixPType(newdest) == fixPType(newsrc))) {
+      LLVM_DEBUG(dbgs() << *memi << " copies between buffers with different formats\n");
+      return nullptr;
+    }
+  } else {
+    if (!newdest)
+      return Unsupported;
+    /* zero is the only byte pattern with the same meaning in every format */
+    ConstantInt *val = dyn_cast<ConstantInt>(cast<MemSetInst>(memi)->getValue());
+    if (!val || !val->isZero()) {
+      LLVM_DEBUG(dbgs() << *memi << " sets a converted buffer to a non-zero value\n");
+      return nullptr;
+    }
+  }
+  
+  const DataLayout& dl = memi->getModule()->getDataLayout();
+  uint64_t oldsize = dl.getTypeAllocSize(oldelemt);
+  uint64_t newsize = dl.getTypeAllocSize(newelemt);
+  
+  Value *len = memi->getLength();
+  Value *newlen;
+  IRBuilder<> builder(memi);
+  if (oldsize == newsize) {
+    newlen = len;
+  } else if (ConstantInt *clen = dyn_cast<ConstantInt>(len)) {
+    uint64_t bytes = clen->getZExtValue();
+    if (bytes % oldsize != 0) {
+      LLVM_DEBUG(dbgs() << *memi << " does not cover whole elements\n");
+      return nullptr;
+    }
+    newlen = ConstantInt::get(len->getType(), bytes / oldsize * newsize);
+  } else if (newsize % oldsize == 0) {
+    newlen = builder.CreateMul(len, ConstantInt::get(len->getType(), newsize / oldsize));
+  } else if (oldsize % newsize == 0) {
+    newlen = builder.CreateExactUDiv(len, ConstantInt::get(len->getType(), oldsize / newsize));
+  } else {
+    newlen = builder.CreateExactUDiv(len, ConstantInt::get(len->getType(), oldsize));
+    newlen = builder.CreateMul(newlen, ConstantInt::get(len->getType(), newsize));
+  }
+  
+  /* offsets into the buffer are scaled, so the alignment of the pointers
+   * is only guaranteed up to that of the new element */
+  unsigned elemalign = dl.getABITypeAlignment(newelemt);
+  memi->setDest(builder.CreatePointerCast(newdest, memi->getRawDest()->getType()));
+  if (memi->getDestAlignment() > elemalign)
+    memi->setDestAlignment(MaybeAlign(elemalign));
+  if (memt) {
+    memt->setSource(builder.CreatePointerCast(newsrc, memt->getRawSource()->getType()));
+    if (memt->getSourceAlignment() > elemalign)
+      memt->setSourceAlignment(MaybeAlign(elemalign));
+  }
+  memi->setLength(newlen);
+  
+  LLVM_DEBUG(dbgs() << "rescaled " << *memi << " from element size " << oldsize << " to " << newsize << "\n");
+  return memi;
+}
+
+
 Value *FloatToFixed::convertCmp(FCmpInst *fcmp)
 {
   Value *op1 = fcmp->getOperand(0);
   Value *op2 = fcmp->getOperand(1);
   
+  /* comparisons between values which are both left in floating point
+   * are better left to the fallback */
+  bool isconv1 = hasInfo(op1) && !valueInfo(op1)->noTypeConversion;
+  bool isconv2 = hasInfo(op2) && !valueInfo(op2)->noTypeConversion;
+  if (!isconv1 && !isconv2)
+    return Unsupported;
+  
+  if (Value *res = convertCmpWithConstant(fcmp))
+    return res;
+  
   FixedPointType cmptype;
   FixedPointType t1, t2;
   bool hasinfo1 = hasInfo(op1), hasinfo2 = hasInfo(op2);
@@ -594,7 +998,7 @@ Value *FloatToFixed::convertCmp(FCmpInst *fcmp)
   int intpart2 = t2.scalarBitsAmt() - t2.scalarFracBitsAmt() + (mixedsign ? t2.scalarIsSigned() : 0);
   cmptype.scalarIsSigned() = t1.scalarIsSigned() || t2.scalarIsSigned();
   cmptype.scalarFracBitsAmt() = std::max(t1.scalarFracBitsAmt(), t2.scalarFracBitsAmt());
-  cmptype.scalarBitsAmt() = std::max(intpart1, intpart2) + cmptype.scalarFracBitsAmt();
+  cmptype.scalarBitsAmt() = getLegalIntegerWidth(std::max(intpart1, intpart2) + cmptype.scalarFracBitsAmt(), fcmp->getFunction());
   
   Value *val1 = translateOrMatchOperandAndType(op1, cmptype, fcmp);
   Value *val2 = translateOrMatchOperandAndType(op2, cmptype, fcmp);
@@ -647,6 +1051,123 @@ Value *FloatToFixed::convertCmp(FCmpInst *fcmp)
 }
 
 
+Value *FloatToFixed::convertCmpWithConstant(FCmpInst *fcmp)
+{
+  Value *op1 = fcmp->getOperand(0);
+  Value *op2 = fcmp->getOperand(1);
+  CmpInst::Predicate pr = fcmp->getPredicate();
+  
+  /* canonicalize to "var pr const" */
+  ConstantFP *cst = dyn_cast<ConstantFP>(op2);
+  Value *var = op1;
+  if (!cst) {
+    cst = dyn_cast<ConstantFP>(op1);
+    var = op2;
+    pr = CmpInst::getSwappedPredicate(pr);
+  }
+  if (!cst || isa<Constant>(var) || !var->getType()->isFloatingPointTy())
+    return nullptr;
+  if (cst->getValueAPF().isNaN())
+    return nullptr;
+  
+  /* the comparison is performed in the format of the variable operand, thus
+   * it must have been already converted */
+  Value *newvar = operandPool[var];
+  if (!newvar || newvar == ConversionError || !hasInfo(var) || valueInfo(var)->noTypeConversion)
+    return nullptr;
+  if (!hasInfo(newvar) || !newvar->getType()->isIntegerTy())
+    return nullptr;
+  const FixedPointType& fixpt = fixPType(newvar);
+  
+  /* fixed point values are never NaN, thus unordered predicates are the
+   * same as the ordered ones */
+  switch (pr) {
+    case CmpInst::FCMP_UEQ: pr = CmpInst::FCMP_OEQ; break;
+    case CmpInst::FCMP_UNE: pr = CmpInst::FCMP_ONE; break;
+    case CmpInst::FCMP_UGT: pr = CmpInst::FCMP_OGT; break;
+    case CmpInst::FCMP_UGE: pr = CmpInst::FCMP_OGE; break;
+    case CmpInst::FCMP_ULT: pr = CmpInst::FCMP_OLT; break;
+    case CmpInst::FCMP_ULE: pr = CmpInst::FCMP_OLE; break;
+    case CmpInst::FCMP_OEQ: case CmpInst::FCMP_ONE: case CmpInst::FCMP_OGT:
+    case CmpInst::FCMP_OGE: case CmpInst::FCMP_OLT: case CmpInst::FCMP_OLE:
+      break;
+    default:
+      return nullptr;
+  }
+  
+  /* round the constant towards negative infinity in the format of the
+   * variable; the scaling by a power of two is always exact */
+  unsigned bits = fixpt.scalarBitsAmt();
+  APFloat scaled = scalbn(cst->getValueAPF(), fixpt.scalarFracBitsAmt(), APFloat::rmNearestTiesToEven);
+  /* -0.0 is equal to 0.0, but convertToInteger() reports it as inexact */
+  if (scaled.isNegZero())
+    scaled.clearSign();
+  APSInt k(bits + 2, false);
+  bool isexact = false;
+  APFloat::opStatus cvtres = scaled.convertToInteger(k, APFloat::rmTowardNegative, &isexact);
+  
+  APSInt minval = fixpt.scalarIsSigned() ? APSInt::getMinValue(bits, false) : APSInt::getMinValue(bits, true);
+  APSInt maxval = fixpt.scalarIsSigned() ? APSInt::getMaxValue(bits, false) : APSInt::getMaxValue(bits, true);
+  minval = minval.extend(bits + 2);
+  minval.setIsSigned(true);
+  maxval = maxval.extend(bits + 2);
+  maxval.setIsSigned(true);
+  
+  LLVMContext& ctxt = fcmp->getContext();
+  bool below, above;
+  if (cvtres == APFloat::opInvalidOp) {
+    below = scaled.isNegative();
+    above = !below;
+  } else {
+    below = k < minval;
+    above = k > maxval;
+  }
+  if (below || above) {
+    /* all the values of the variable are on the same side of the constant */
+    bool varless = above;
+    bool res;
+    switch (pr) {
+      case CmpInst::FCMP_OEQ: res = false; break;
+      case CmpInst::FCMP_ONE: res = true; break;
+      case CmpInst::FCMP_OLT: case CmpInst::FCMP_OLE: res = varless; break;
+      default: res = !varless; break;
+    }
+    LLVM_DEBUG(dbgs() << *fcmp << " is always " << res << " in format " << fixpt << "\n");
+    return res ? ConstantInt::getTrue(ctxt) : ConstantInt::getFalse(ctxt);
+  }
+  
+  /* with k = floor(c), when c is not an integer:
+   *   x < c  <=>  x <= k
+   *   x >= c <=>  x > k
+   * while x <= c and x > c do not change */
+  if (!isexact) {
+    if (pr == CmpInst::FCMP_OEQ)
+      return ConstantInt::getFalse(ctxt);
+    if (pr == CmpInst::FCMP_ONE)
+      return ConstantInt::getTrue(ctxt);
+    if (pr == CmpInst::FCMP_OLT)
+      pr = CmpInst::FCMP_OLE;
+    else if (pr == CmpInst::FCMP_OGE)
+      pr = CmpInst::FCMP_OGT;
+  }
+  
+  bool sign = fixpt.scalarIsSigned();
+  CmpInst::Predicate ty;
+  switch (pr) {
+    case CmpInst::FCMP_OEQ: ty = CmpInst::ICMP_EQ; break;
+    case CmpInst::FCMP_ONE: ty = CmpInst::ICMP_NE; break;
+    case CmpInst::FCMP_OGT: ty = sign ? CmpInst::ICMP_SGT : CmpInst::ICMP_UGT; break;
+    case CmpInst::FCMP_OGE: ty = sign ? CmpInst::ICMP_SGE : CmpInst::ICMP_UGE; break;
+    case CmpInst::FCMP_OLT: ty = sign ? CmpInst::ICMP_SLT : CmpInst::ICMP_ULT; break;
+    default: ty = sign ? CmpInst::ICMP_SLE : CmpInst::ICMP_ULE; break;
+  }
+  
+  Constant *newcst = ConstantInt::get(newvar->getType(), k.trunc(bits));
+  IRBuilder<> builder(fcmp->getNextNode());
+  return builder.CreateICmp(ty, newvar, newcst);
+}
+
+
 Value *FloatToFixed::convertCast(CastInst *cast, const FixedPointType& fixpt)
 {
   /* Instruction opcodes:
@@ -706,6 +1227,7 @@ Value *FloatToFixed::fallback(Instruction *unsupp, FixedPointType& fixpt)
 
   LLVM_DEBUG(dbgs() << "[Fallback] attempt to wrap not supported operation:\n" << *unsupp << "\n");
   FallbackCount++;
+  result.fallbacks++;
 
   for (int i=0,n=unsupp->getNumOperands();i<n;i++) {
     fallval = unsupp->getOperand(i);
@@ -733,6 +1255,7 @@ Value *FloatToFixed::fallback(Instruction *unsupp, FixedPointType& fixpt)
     tmp->setOperand(i, newops[i]);
   }
   LLVM_DEBUG(dbgs() << "  mutated operands to:\n" << *tmp << "\n");
+  instrumentConversion(tmp, unsupp, ConversionSiteKind::Fallback);
   if (tmp->getType()->isFloatingPointTy() && valueInfo(unsupp)->noTypeConversion == false) {
     Value *fallbackv = genConvertFloatToFix(tmp, fixpt, getFirstInsertionPointAfter(tmp));
     if (tmp->hasName())
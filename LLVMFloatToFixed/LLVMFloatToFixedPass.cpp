@@ -1,3 +1,4 @@
+#include <cmath>
 #include "llvm/Pass.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Function.h"
@@ -6,10 +7,20 @@
 #include "llvm/IR/InstIterator.h"
 #include "llvm/IR/Intrinsics.h"
 #include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SetVector.h"
 #include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/IVDescriptors.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/MathExtras.h"
 #include <llvm/Transforms/Utils/ValueMapper.h>
 #include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Utils/CallPromotionUtils.h>
+#include <llvm/Transforms/Utils/Local.h>
 #include "LLVMFloatToFixedPass.h"
 #include "TypeUtils.h"
 
@@ -19,6 +30,11 @@ using namespace flttofix;
 using namespace taffo;
 
 
+static cl::opt<std::string> ConversionLog("fixp-conversion-log",
+  cl::desc("File where the converted instructions are listed (empty for no file)"),
+  cl::init("conversion"));
+
+
 char FloatToFixed::ID = 0;
 
 static RegisterPass<FloatToFixed> X(
@@ -28,9 +44,31 @@ static RegisterPass<FloatToFixed> X(
   true /* Optimization Pass */);
 
 
+std::recursive_mutex& flttofix::getMetadataManagerMutex()
+{
+  static std::recursive_mutex mutex;
+  return mutex;
+}
+
+
+FloatToFixed::FloatToFixed(): FloatToFixed(FloatToFixedOptions::fromCommandLine())
+{
+  options.conversionLog = ConversionLog;
+}
+
+
+FloatToFixed::FloatToFixed(const FloatToFixedOptions& options): ModulePass(ID), options(options)
+{
+}
+
+
 void FloatToFixed::getAnalysisUsage(llvm::AnalysisUsage &au) const
 {
   au.addRequiredTransitive<LoopInfoWrapperPass>();
+  au.addRequired<TargetLibraryInfoWrapperPass>();
+  au.addRequired<TargetTransformInfoWrapperPass>();
+  au.addRequired<BlockFrequencyInfoWrapperPass>();
+  au.addRequired<ProfileSummaryInfoWrapperPass>();
   au.setPreservesAll();
 }
 
@@ -39,26 +77,77 @@ bool FloatToFixed::runOnModule(Module &m)
 {
   llvm::SmallPtrSet<llvm::Value *, 32> local;
   llvm::SmallPtrSet<llvm::Value *, 32> global;
+  resetState();
+  result = ConversionResult();
+  dataLayout = &m.getDataLayout();
+  if (options.profileRanges) {
+    instrumentRanges(m);
+    result.changed = true;
+    return true;
+  }
   readAllLocalMetadata(m, local);
   readGlobalMetadata(m, global);
 
   std::vector<Value*> vals(local.begin(), local.end());
   vals.insert(vals.begin(), global.begin(), global.end());
   MetadataCount = vals.size();
+  result.metadataValues = vals.size();
 
+  promoteIndirectCalls(vals);
+  widenReductions(vals);
   sortQueue(vals);
   propagateCall(vals, global);
+  pruneColdCode(vals);
+  pruneUnprofitableRegions(vals);
   LLVM_DEBUG(printConversionQueue(vals));
   ConversionCount = vals.size();
+  result.queuedValues = vals.size();
 
+  collectPackableStructs(m);
   performConversion(m, vals);
+  for (auto& conv: operandPool) {
+    if (conv.second == ConversionError)
+      result.conversionErrors++;
+  }
   closePhiLoops();
   cleanup(vals);
+  removeDeadClones(m);
+  finalizeConversionInstrumentation(m);
 
+  result.changed = true;
   return true;
 }
 
 
+void FloatToFixed::releaseMemory()
+{
+  resetState();
+}
+
+
+void FloatToFixed::resetState()
+{
+  operandPool.clear();
+  functionPool.clear();
+  info.clear();
+  phiReplacementData.clear();
+  indirectTargets.clear();
+  phiIncomingConversions.clear();
+  wideValues.clear();
+  valueRanges.clear();
+  blockWeights.clear();
+  weightedFunctions.clear();
+  loopNests.clear();
+  packableStructs.clear();
+  packedStructTypes.clear();
+  structFieldPermutation.clear();
+  literalCache.clear();
+  mergedConstantGlobals.clear();
+  pendingConversions.clear();
+  dataLayout = nullptr;
+}
+
+
 int FloatToFixed::getLoopNestingLevelOfValue(llvm::Value *v)
 {
   Instruction *inst = dyn_cast<Instruction>(v);
@@ -72,6 +161,81 @@ int FloatToFixed::getLoopNestingLevelOfValue(llvm::Value *v)
 }
 
 
+double FloatToFixed::getExecutionWeightOfValue(llvm::Value *v)
+{
+  Instruction *inst = dyn_cast<Instruction>(v);
+  if (!inst)
+    return 1.0;
+
+  computeBlockWeights(inst->getFunction());
+  /* blocks created by the conversion (e.g. split edges) have no weight
+   * of their own; they execute at most as often as their predecessor */
+  BasicBlock *bb = inst->getParent();
+  SmallPtrSet<BasicBlock *, 4> visited;
+  while (bb && visited.insert(bb).second) {
+    auto w = blockWeights.find(bb);
+    if (w != blockWeights.end())
+      return w->second;
+    bb = bb->getSinglePredecessor();
+  }
+  return 1.0;
+}
+
+
+void FloatToFixed::computeBlockWeights(llvm::Function *f)
+{
+  if (!weightedFunctions.insert(f).second)
+    return;
+
+  if (f->hasProfileData()) {
+    BlockFrequencyInfo &bfi = this->getAnalysis<BlockFrequencyInfoWrapperPass>(*f).getBFI();
+    double entry = (double)bfi.getEntryFreq();
+    for (BasicBlock& bb: *f)
+      blockWeights[&bb] = (double)bfi.getBlockFreq(&bb).getFrequency() / entry;
+    return;
+  }
+  LoopInfo &li = this->getAnalysis<LoopInfoWrapperPass>(*f).getLoopInfo();
+  for (BasicBlock& bb: *f)
+    blockWeights[&bb] = std::pow(2.0, std::min((int)(sizeof(int)*8-1), (int)li.getLoopDepth(&bb)));
+}
+
+
+const FloatToFixed::LoopNest& FloatToFixed::getLoopNest(llvm::Function *f)
+{
+  auto cached = loopNests.find(f);
+  if (cached != loopNests.end())
+    return cached->second;
+
+  LoopInfo &li = this->getAnalysis<LoopInfoWrapperPass>(*f).getLoopInfo();
+  return loopNests[f] = buildLoopNest(f, li);
+}
+
+
+FloatToFixed::LoopNest FloatToFixed::buildLoopNest(llvm::Function *f, LoopInfo& li)
+{
+  LoopNest nest;
+  DenseMap<Loop *, int> index;
+  /* the parents come before their children */
+  for (Loop *l: li.getLoopsInPreorder()) {
+    int parent = l->getParentLoop() ? index[l->getParentLoop()] : -1;
+    index[l] = nest.loops.size();
+    nest.loops.push_back({parent, l->getLoopPreheader()});
+  }
+  for (BasicBlock& bb: *f) {
+    Loop *l = li.getLoopFor(&bb);
+    nest.innermost[&bb] = l ? index[l] : -1;
+  }
+  return nest;
+}
+
+
+bool FloatToFixed::isColdFunction(llvm::Function *f)
+{
+  ProfileSummaryInfo &psi = getAnalysis<ProfileSummaryInfoWrapperPass>().getPSI();
+  return psi.hasProfileSummary() && psi.isFunctionEntryCold(f);
+}
+
+
 void FloatToFixed::openPhiLoop(PHINode *phi)
 {
   PHIInfo info;
@@ -127,6 +291,112 @@ void FloatToFixed::closePhiLoops()
 }
 
 
+/* Collects the instructions of the chain of a floating point sum reduction,
+ * from the phi to the value which is carried around the loop */
+static void collectReductionChain(PHINode *phi, Loop *l, SmallPtrSetImpl<Instruction *>& chain)
+{
+  SmallVector<Instruction *, 8> worklist;
+  chain.insert(phi);
+  worklist.push_back(phi);
+  while (!worklist.empty()) {
+    Instruction *inst = worklist.pop_back_val();
+    for (Use& u: inst->uses()) {
+      Instruction *user = cast<Instruction>(u.getUser());
+      if (!l->contains(user))
+        continue;
+      unsigned opc = user->getOpcode();
+      if (opc == Instruction::FAdd || (opc == Instruction::FSub && u.getOperandNo() == 0) ||
+          isa<PHINode>(user) || (isa<SelectInst>(user) && u.getOperandNo() != 0)) {
+        if (chain.insert(user).second)
+          worklist.push_back(user);
+      }
+    }
+  }
+}
+
+
+void FloatToFixed::widenReductions(std::vector<Value *> &vals)
+{
+  if (!options.widenReductions)
+    return;
+  
+  SmallPtrSet<Function *, 8> funcs;
+  for (Value *v: vals) {
+    if (Instruction *i = dyn_cast<Instruction>(v))
+      funcs.insert(i->getFunction());
+  }
+  
+  for (Function *f: funcs) {
+    if (functionPool.find(f) != functionPool.end())
+      continue;
+    LoopInfo &li = getAnalysis<LoopInfoWrapperPass>(*f).getLoopInfo();
+    for (Loop *l: li.getLoopsInPreorder()) {
+      for (PHINode& phi: l->getHeader()->phis()) {
+        if (!phi.getType()->isFloatingPointTy() || !hasInfo(&phi))
+          continue;
+        std::shared_ptr<ValueInfo> vi = valueInfo(&phi);
+        if (vi->noTypeConversion || vi->fixpType.isInvalid())
+          continue;
+        
+        /* fixed point additions are associative, thus the reduction
+         * does not need to be marked as such by fast-math flags */
+        RecurrenceDescriptor rd;
+        if (!RecurrenceDescriptor::isReductionPHI(&phi, l, rd))
+          continue;
+        if (rd.getRecurrenceKind() != RecurrenceDescriptor::RK_FloatAdd)
+          continue;
+        
+        SmallPtrSet<Instruction *, 8> chain;
+        collectReductionChain(&phi, l, chain);
+        if (!chain.count(rd.getLoopExitInstr()))
+          continue;
+        /* the accumulated value leaves the loop through LCSSA phis */
+        SmallVector<Instruction *, 4> exits;
+        for (User *u: rd.getLoopExitInstr()->users()) {
+          PHINode *lcssa = dyn_cast<PHINode>(u);
+          if (lcssa && !l->contains(lcssa))
+            exits.push_back(lcssa);
+        }
+        bool ok = true;
+        for (Instruction *i: chain)
+          ok = ok && hasInfo(i) && !valueInfo(i)->noTypeConversion && !fixPType(i).isInvalid();
+        for (Instruction *i: exits)
+          ok = ok && hasInfo(i) && !valueInfo(i)->noTypeConversion && !fixPType(i).isInvalid();
+        if (!ok)
+          continue;
+        
+        /* guard bits go to the integer part, the remaining bits up to the
+         * next power of two increase the precision */
+        const FixedPointType& oldt = vi->fixpType;
+        int bits = oldt.scalarBitsAmt();
+        int intbits = bits - oldt.scalarFracBitsAmt();
+        int guard = std::min<int>(options.reductionGuardBits, 64 - bits);
+        int newbits = PowerOf2Ceil(bits + guard);
+        if (newbits > 64 || newbits <= bits)
+          continue;
+        /* an accumulator wider than the native integers would make every
+         * addition in the loop more expensive than the conversions it saves */
+        const TargetTransformInfo& tti = getAnalysis<TargetTransformInfoWrapperPass>().getTTI(*f);
+        if (!f->getParent()->getDataLayout().isLegalInteger(newbits) &&
+            !tti.isTypeLegal(IntegerType::get(f->getContext(), newbits))) {
+          LLVM_DEBUG(dbgs() << "not widening reduction " << phi << ": i" << newbits << " is not legal\n");
+          continue;
+        }
+        FixedPointType newt(oldt.scalarIsSigned(), newbits - intbits - guard, newbits);
+        
+        LLVM_DEBUG(dbgs() << "widening reduction " << phi << " from " << oldt << " to " << newt << "\n");
+        for (Instruction *i: chain)
+          fixPType(i) = newt;
+        for (Instruction *i: exits)
+          fixPType(i) = newt;
+        WidenedReductionCount++;
+        result.widenedReductions++;
+      }
+    }
+  }
+}
+
+
 void FloatToFixed::sortQueue(std::vector<Value *> &vals)
 {
   size_t next = 0;
@@ -302,9 +572,115 @@ void FloatToFixed::cleanup(const std::vector<Value*>& q)
   phiReplacementData.clear();
   clear(isa<PHINode>);
 
+  /* the original values and everything they used become dead once the
+   * instructions above are gone */
+  SmallSetVector<Instruction *, 64> worklist;
+  SmallPtrSet<Instruction *, 32> erased(toErase.begin(), toErase.end());
+  for (Value *v: q) {
+    Instruction *i = dyn_cast<Instruction>(v);
+    if (i && !erased.count(i))
+      worklist.insert(i);
+  }
+  for (Instruction *v: toErase) {
+    for (Value *op: v->operands()) {
+      Instruction *opi = dyn_cast<Instruction>(op);
+      if (opi && !erased.count(opi))
+        worklist.insert(opi);
+    }
+  }
+
   for (Instruction *v: toErase) {
     v->eraseFromParent();
   }
+
+  while (!worklist.empty()) {
+    Instruction *i = worklist.pop_back_val();
+    if (!isInstructionTriviallyDead(i))
+      continue;
+    for (Value *op: i->operands()) {
+      if (Instruction *opi = dyn_cast<Instruction>(op))
+        worklist.insert(opi);
+    }
+    LLVM_DEBUG(dbgs() << "removing dead instruction " << *i << "\n");
+    info.erase(i);
+    operandPool.erase(i);
+    i->eraseFromParent();
+    DeadInstructionCount++;
+    result.deadInstructions++;
+  }
+}
+
+
+/* Returns if all the uses of a value are in the given functions */
+static bool isOnlyUsedIn(Value *v, const SmallPtrSetImpl<Function *>& funcs)
+{
+  for (User *u: v->users()) {
+    if (Instruction *i = dyn_cast<Instruction>(u)) {
+      if (!funcs.count(i->getFunction()))
+        return false;
+    } else if (isa<ConstantExpr>(u)) {
+      if (!isOnlyUsedIn(u, funcs))
+        return false;
+    } else {
+      /* global initializers, llvm.used, aliases... */
+      return false;
+    }
+  }
+  return true;
+}
+
+
+void FloatToFixed::removeDeadClones(Module& m)
+{
+  if (!options.removeDeadClones)
+    return;
+
+  SmallPtrSet<Function *, 8> dead;
+  for (auto& entry: functionPool) {
+    Function *f = entry.first;
+    /* other modules may call the clones which are visible outside */
+    if (f->getMetadata(SOURCE_FUN_METADATA) && !f->isDeclaration() && f->isDiscardableIfUnused())
+      dead.insert(f);
+  }
+
+  /* a group of clones which only call each other is dead as a whole */
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (Function *f: SmallVector<Function *, 8>(dead.begin(), dead.end())) {
+      if (!isOnlyUsedIn(f, dead)) {
+        dead.erase(f);
+        changed = true;
+      }
+    }
+  }
+  if (dead.empty())
+    return;
+
+  for (auto it = info.begin(); it != info.end();) {
+    Function *parent = nullptr;
+    if (Instruction *i = dyn_cast<Instruction>(it->first))
+      parent = i->getFunction();
+    else if (Argument *arg = dyn_cast<Argument>(it->first))
+      parent = arg->getParent();
+    auto cur = it++;
+    if (parent && dead.count(parent))
+      info.erase(cur);
+  }
+
+  for (Function *f: dead) {
+    LLVM_DEBUG(dbgs() << "removing dead original clone " << f->getName() << "\n");
+    DeadCloneCount++;
+    result.deadClones++;
+    DeadCloneInstructionCount += f->getInstructionCount();
+    functionPool.erase(f);
+    f->dropAllReferences();
+  }
+  for (Function *f: dead) {
+    /* the constant expressions using f were only used by dead code */
+    f->removeDeadConstantUsers();
+    f->eraseFromParent();
+  }
 }
 
 
@@ -321,13 +697,22 @@ void FloatToFixed::propagateCall(std::vector<Value *> &vals, llvm::SmallPtrSetIm
     
     bool alreadyHandledNewF;
     Function *oldF = call.getCalledFunction();
-    Function *newF = createFixFun(&call, &alreadyHandledNewF);
+    if (!oldF) {
+      LLVM_DEBUG(dbgs() << "Indirect call " << *valsi << " left to the fallback\n");
+      continue;
+    }
+    Function *newF = createFixFun(&call, oldF, &alreadyHandledNewF);
     if (!newF) {
       LLVM_DEBUG(dbgs() << "Attempted to clone function " << oldF->getName() << " but failed\n");
       continue;
     }
+    /* only the values of the clones made by the Initializer are dropped
+     * from the queue; the other functions (the possible callees of
+     * promoted indirect calls) still have to be converted in place */
+    bool isClone = oldF->getMetadata(SOURCE_FUN_METADATA);
     if (alreadyHandledNewF) {
-      oldFuncs.insert(oldF);
+      if (isClone)
+        oldFuncs.insert(oldF);
       continue;
     }
     
@@ -389,7 +774,8 @@ void FloatToFixed::propagateCall(std::vector<Value *> &vals, llvm::SmallPtrSetIm
     newIt = newF->arg_begin();
     for (; oldIt != oldF->arg_end(); oldIt++, newIt++) {
       if (oldIt->getType() != newIt->getType()) {
-        *(valueInfo(newIt)) = *(valueInfo(oldIt));
+        /* arguments of possible callees of indirect calls may lack metadata */
+        *(demandValueInfo(newIt)) = *(valueInfo(oldIt));
       }
     }
     
@@ -405,9 +791,12 @@ void FloatToFixed::propagateCall(std::vector<Value *> &vals, llvm::SmallPtrSetIm
     }
     
     LLVM_DEBUG(dbgs() << "Sorting queue of new function " << newF->getName() << "\n");
+    promoteIndirectCalls(newVals);
+    widenReductions(newVals);
     sortQueue(newVals);
     
-    oldFuncs.insert(oldF);
+    if (isClone)
+      oldFuncs.insert(oldF);
     
     /* Put the instructions from the new function in */
     for (Value *val : newVals){
@@ -443,17 +832,19 @@ void FloatToFixed::propagateCall(std::vector<Value *> &vals, llvm::SmallPtrSetIm
 }
 
 
-Function* FloatToFixed::createFixFun(CallSite* call, bool *old)
+Function* FloatToFixed::createFixFun(CallSite* call, Function *oldF, bool *old)
 {
-  Function *oldF = call->getCalledFunction();
-  assert(oldF && "bitcasted function pointers and such not handled atm");
   if (isSpecialFunction(oldF))
     return nullptr;
 
-  if (!oldF->getMetadata(SOURCE_FUN_METADATA)) {
+  if (!oldF->getMetadata(SOURCE_FUN_METADATA) && !indirectTargets.count(oldF)) {
     LLVM_DEBUG(dbgs() << "createFixFun: function " << oldF->getName() << " not a clone; ignoring\n");
     return nullptr;
   }
+  if (options.skipColdCode && isColdFunction(oldF)) {
+    LLVM_DEBUG(dbgs() << "createFixFun: function " << oldF->getName() << " is cold; leaving it in floating point\n");
+    return nullptr;
+  }
 
   std::vector<Type*> typeArgs;
   std::vector<std::pair<int, FixedPointType>> fixArgs; //for match already converted function
@@ -512,10 +903,122 @@ Function* FloatToFixed::createFixFun(CallSite* call, bool *old)
   newF = Function::Create(newFunTy, oldF->getLinkage(), oldF->getName() + "_" + suffix, oldF->getParent());
   functionPool[oldF] = newF; //add to pool
   FunctionCreated++;
+  result.functionsCreated++;
   return newF;
 }
 
 
+/* Returns if a function type has floating point arguments or return value */
+static bool hasFloatInterface(FunctionType *fty)
+{
+  if (isFloatType(fty->getReturnType()))
+    return true;
+  for (Type *paramt: fty->params()) {
+    if (isFloatType(paramt))
+      return true;
+  }
+  return false;
+}
+
+
+bool FloatToFixed::hasConvertedInterface(CallSite call)
+{
+  auto isConverted = [this](Value *v) -> bool {
+    return hasInfo(v) && !valueInfo(v)->noTypeConversion && !valueInfo(v)->fixpType.isInvalid();
+  };
+  if (isFloatType(call.getType()) && isConverted(call.getInstruction()))
+    return true;
+  for (Value *arg: call.args()) {
+    if (isFloatType(arg->getType()) && isConverted(arg))
+      return true;
+  }
+  return false;
+}
+
+
+void FloatToFixed::promoteIndirectCalls(std::vector<Value *> &vals)
+{
+  if (options.maxIndirectTargets == 0)
+    return;
+  
+  SmallPtrSet<Function *, 8> funcs;
+  for (Value *v: vals) {
+    if (Instruction *i = dyn_cast<Instruction>(v))
+      funcs.insert(i->getFunction());
+  }
+  
+  for (Function *f: funcs) {
+    if (functionPool.find(f) != functionPool.end())
+      continue;
+    
+    std::vector<CallSite> indirect;
+    for (Instruction& i: instructions(*f)) {
+      CallSite call(&i);
+      if (!call.getInstruction() || call.getCalledFunction() || call.isInlineAsm())
+        continue;
+      if (hasFloatInterface(call.getFunctionType()) && hasConvertedInterface(call))
+        indirect.push_back(call);
+    }
+    
+    for (CallSite call: indirect) {
+      /* the possible callees are the functions of the same type whose
+       * address is taken */
+      SmallVector<Function *, 4> targets;
+      for (Function& target: *(f->getParent())) {
+        if (target.isDeclaration() || isSpecialFunction(&target) || !target.hasAddressTaken())
+          continue;
+        if (target.getFunctionType() != call.getFunctionType())
+          continue;
+        if (!isLegalToPromote(call, &target))
+          continue;
+        targets.push_back(&target);
+      }
+      if (targets.empty() || targets.size() > options.maxIndirectTargets) {
+        LLVM_DEBUG(dbgs() << "not promoting " << *call.getInstruction() << ": " << targets.size() << " possible callees\n");
+        continue;
+      }
+      
+      Instruction *origcall = call.getInstruction();
+      for (Function *target: targets) {
+        /* the original indirect call stays as the fallback when the pointer
+         * matches none of the known callees */
+        Instruction *direct = promoteCallWithIfThenElse(call, target);
+        LLVM_DEBUG(dbgs() << "promoted " << *origcall << " to " << *direct << "\n");
+        cpMetaData(direct, origcall);
+        if (hasInfo(origcall))
+          *(newValueInfo(direct)) = *(valueInfo(origcall));
+        for (User *u: direct->users()) {
+          PHINode *retphi = dyn_cast<PHINode>(u);
+          if (!retphi || hasInfo(retphi))
+            continue;
+          cpMetaData(retphi, origcall);
+          if (hasInfo(origcall))
+            *(newValueInfo(retphi)) = *(valueInfo(origcall));
+        }
+        
+        /* functions which are not clones made for a call site do not have
+         * argument metadata; use the types of the actual arguments */
+        unsigned argi = 0;
+        for (Argument& arg: target->args()) {
+          Value *actual = call.getArgument(argi++);
+          if (hasInfo(&arg) || !hasInfo(actual))
+            continue;
+          std::shared_ptr<ValueInfo> actualvi = valueInfo(actual);
+          if (actualvi->noTypeConversion || actualvi->fixpType.isInvalid())
+            continue;
+          std::shared_ptr<ValueInfo> argvi = newValueInfo(&arg);
+          argvi->fixpType = actualvi->fixpType;
+          argvi->origType = arg.getType();
+        }
+        indirectTargets.insert(target);
+      }
+      IndirectCallPromotedCount++;
+      result.promotedIndirectCalls++;
+    }
+  }
+}
+
+
 void FloatToFixed::printConversionQueue(std::vector<Value*> vals)
 {
   if (vals.size() > 1000) {
@@ -1,18 +1,29 @@
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
 #include "llvm/Pass.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/CallSite.h"
+#include "llvm/IR/DataLayout.h"
 #include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/SmallSet.h"
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/Optional.h"
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/IR/ValueMap.h"
+#include "llvm/Analysis/LoopInfo.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Error.h"
 #include "TypeUtils.h"
 #include "Metadata.h"
 #include "FixedPointType.h"
+#include "FloatToFixedConverter.h"
 #include "InputInfo.h"
 
 #ifndef __LLVM_FLOAT_TO_FIXED_PASS_H__
@@ -26,21 +37,45 @@
 STATISTIC(FixToFloatCount, "Number of generic fixed point to floating point value conversion operations inserted");
 STATISTIC(FloatToFixCount, "Number of generic floating point to fixed point value conversion operations inserted");
 STATISTIC(FixToFloatWeight, "Number of generic fixed point to floating point value conversion operations inserted,"
-  " weighted by the loop depth");
+  " weighted by the block frequency (or by the loop depth when no profile is available)");
 STATISTIC(FloatToFixWeight, "Number of generic floating point to fixed point value conversion operations inserted,"
-  " weighted by the loop depth");
+  " weighted by the block frequency (or by the loop depth when no profile is available)");
 STATISTIC(FallbackCount, "Number of instructions not replaced by a fixed-point-native equivalent");
 STATISTIC(ConversionCount, "Number of instructions affected by flttofix");
 STATISTIC(MetadataCount, "Number of valid Metadata found");
 STATISTIC(FunctionCreated, "Number of fixed point function inserted");
+STATISTIC(FusedMACCount, "Number of additions accumulating products without intermediate normalization");
+STATISTIC(WidenedReductionCount, "Number of reduction accumulators widened with guard bits");
+STATISTIC(IndirectCallPromotedCount, "Number of indirect calls promoted to direct calls to converted functions");
+STATISTIC(NarrowStorageCount, "Number of arrays stored in a narrower format than the one used for computation");
+STATISTIC(PackedStructCount, "Number of converted struct types whose fields have been reordered to reduce padding");
+STATISTIC(ColdValueCount, "Number of values left in floating point because they are in cold code");
+STATISTIC(UnprofitableLoopCount, "Number of loops left in floating point because their conversion was estimated unprofitable");
+STATISTIC(ProfiledValueCount, "Number of values instrumented for recording their range at runtime");
+STATISTIC(LiteralCacheHitCount, "Number of literal conversions reused from previous occurrences of the same literal");
+STATISTIC(MergedConstantGlobalCount, "Number of converted constant globals sharing the storage of an identical one");
+STATISTIC(DeadInstructionCount, "Number of original instructions removed after the conversion");
+STATISTIC(DeadCloneCount, "Number of original function clones removed after the conversion");
+STATISTIC(DeadCloneInstructionCount, "Number of instructions in the original function clones removed after the conversion");
 
 
-/* flags in conversionPool */
-extern llvm::Value *ConversionError;
-extern llvm::Value *Unsupported;
+namespace flttofix {
 
 
-namespace flttofix {
+/** Collects the floating point values whose range is recorded by the
+ *  range profiling instrumentation, in the order of their entries in the
+ *  profile. */
+void collectProfiledValues(llvm::Module& m, std::vector<llvm::Value *>& res);
+
+/** Minimum and maximum of a value observed at runtime */
+typedef std::pair<double, double> ObservedRange;
+
+/** Merges into ranges the entries of a range profile written by the
+ *  runtime which belong to the given module. The ranges are indexed by
+ *  the position of their value in collectProfiledValues().
+ *  @param source The name of the profile, for the error messages. */
+llvm::Error mergeRangeProfile(llvm::StringRef profile, llvm::StringRef source, llvm::StringRef module, size_t numvals,
+  std::map<size_t, ObservedRange>& ranges);
 
 
 struct ValueInfo {
@@ -55,6 +90,11 @@ struct ValueInfo {
   
   bool isArgumentPlaceholder = false;
   
+  /* The memory object (or a pointer into it) is stored in a narrower
+   * format than the one used for computation; loads widen the value
+   * back to the format assigned by the DTA */
+  bool isNarrowStorage = false;
+  
   // significant iff origType is a float or a pointer to a float
   // and if operation == Convert
   FixedPointType fixpType;
@@ -68,10 +108,43 @@ struct PHIInfo {
 };
 
 
+/** Kinds of conversion code counted by the runtime instrumentation.
+ *  Keep in sync with runtime/taffo_conversion_counters.c */
+enum class ConversionSiteKind {
+  FloatToFix = 0,
+  FixToFloat,
+  FixToFix,
+  Fallback
+};
+
+
+struct ConversionSite {
+  ConversionSiteKind kind;
+  std::string function;
+  std::string file;
+  unsigned line = 0;
+  unsigned column = 0;
+};
+
+
+/** Returns the mutex which serializes the accesses to the metadata
+ *  manager, whose caches are shared by all the instances of the pass. */
+std::recursive_mutex& getMetadataManagerMutex();
+
+
 struct FloatToFixed : public llvm::ModulePass {
   static char ID;
   FixedPointType defaultFixpType;
   
+  /* flags in operandPool; their addresses are unique to each instance of
+   * the pass, so that instances running concurrently do not share them */
+  llvm::Value *const ConversionError = (llvm::Value *)(&ConversionError);
+  llvm::Value *const Unsupported = (llvm::Value *)(&Unsupported);
+  
+  FloatToFixedOptions options;
+  /** Summary of the last run, kept after the release of the other state */
+  ConversionResult result;
+  
   /** Map from original values to converted values.
    *  Values not to be converted do not appear in the map.
    *  Values which have not been converted successfully are mapped to
@@ -88,24 +161,120 @@ struct FloatToFixed : public llvm::ModulePass {
   
   llvm::ValueMap<llvm::PHINode *, PHIInfo> phiReplacementData;
   
-  FloatToFixed(): ModulePass(ID) { };
+  /** Functions which are possible callees of promoted indirect calls.
+   *  They are converted even if they are not clones made for a
+   *  specific call site. */
+  llvm::SmallPtrSet<llvm::Function *, 8> indirectTargets;
+  
+  /** Conversions of the incoming values of the phis, indexed by value,
+   *  by the block where the conversion is placed and by fixed point type */
+  std::map<std::tuple<llvm::Value *, llvm::BasicBlock *, std::string>, llvm::Value *> phiIncomingConversions;
+  
+  /** Results of multiplications and additions in the wide format in which
+   *  they were computed, before normalization, for the additions which
+   *  use them */
+  llvm::DenseMap<llvm::Value *, std::pair<llvm::Value *, FixedPointType>> wideValues;
+  
+  /** The values keep the range they had when it was first read, even
+   *  after they are replaced */
+  struct ValueRangeMapConfig : llvm::ValueMapConfig<llvm::Value *> {
+    enum { FollowRAUW = false };
+  };
+  /** Ranges in the metadata of the values, copied from the metadata
+   *  manager when they are first read; see getValueRange() */
+  llvm::ValueMap<llvm::Value *, llvm::Optional<mdutils::Range>, ValueRangeMapConfig> valueRanges;
+  
+  /** Execution weights of the basic blocks, computed once per function
+   *  because the function analyses are recomputed at every query */
+  llvm::DenseMap<llvm::BasicBlock *, double> blockWeights;
+  llvm::SmallPtrSet<llvm::Function *, 8> weightedFunctions;
+  
+  /** Loop nest of a function, recorded before the conversion splits any
+   *  edge, because the function analyses are recomputed at every query */
+  struct LoopNest {
+    /** Parent (or -1) and preheader (or nullptr) of every loop */
+    std::vector<std::pair<int, llvm::BasicBlock *>> loops;
+    /** Innermost loop of every block of the function, or -1 */
+    llvm::DenseMap<llvm::BasicBlock *, int> innermost;
+  };
+  llvm::DenseMap<llvm::Function *, LoopNest> loopNests;
+  
+  const llvm::DataLayout *dataLayout = nullptr;
+  
+  /** Struct types only accessed by converted code, whose layout
+   *  can be changed freely */
+  llvm::SmallPtrSet<llvm::StructType *, 8> packableStructs;
+  /** Cache of the converted struct types with reordered fields, indexed
+   *  by original type and by fixed point type */
+  std::map<std::pair<llvm::StructType *, std::string>, llvm::Type *> packedStructTypes;
+  /** Map from a reordered struct type to the new position of each of
+   *  the fields of the original struct */
+  llvm::DenseMap<llvm::StructType *, llvm::SmallVector<unsigned, 8>> structFieldPermutation;
+  
+  /** Key of the cache of the converted literals: literal, type match
+   *  policy, and signedness, fractional bits and width of the requested
+   *  fixed point type */
+  typedef std::tuple<llvm::ConstantFP *, int, bool, int, int> LiteralCacheKey;
+  /** Converted literals with their actual fixed point type */
+  std::map<LiteralCacheKey, std::pair<FixedPointType, llvm::Constant *>> literalCache;
+  
+  /** Key of the converted constant globals which can be merged:
+   *  initializer, fixed point type and address space */
+  typedef std::tuple<llvm::Constant *, std::string, unsigned> ConstantGlobalKey;
+  std::map<ConstantGlobalKey, llvm::GlobalVariable *> mergedConstantGlobals;
+  
+  /** Last instruction of every conversion generated so far, with its
+   *  site and the debug location of the counter. Only the conversions
+   *  still in use at the end are instrumented, so that the ones which are
+   *  replaced or removed as dead are not counted. */
+  std::vector<std::tuple<llvm::WeakVH, ConversionSite, llvm::DebugLoc>> pendingConversions;
+  
+  /** Uses the options given on the command line, including the
+   *  conversion log */
+  FloatToFixed();
+  FloatToFixed(const FloatToFixedOptions& options);
   void getAnalysisUsage(llvm::AnalysisUsage &) const override;
   bool runOnModule(llvm::Module &M) override;
+  void releaseMemory() override;
+  /** Clears all the state of the previous run, except its result */
+  void resetState();
 
   void readGlobalMetadata(llvm::Module &m, llvm::SmallPtrSetImpl<llvm::Value *> &res, bool functionAnnotation = false);
   void readLocalMetadata(llvm::Function &f, llvm::SmallPtrSetImpl<llvm::Value *> &res, bool onlyArguments = false);
   void readAllLocalMetadata(llvm::Module &m, llvm::SmallPtrSetImpl<llvm::Value *> &res);
   bool parseMetaData(llvm::SmallPtrSetImpl<llvm::Value *> *variables, mdutils::MDInfo *fpInfo, llvm::Value *instr);
+  /** Returns the range in the metadata of v, if any. The information
+   *  of the metadata manager is shared by all the conversions, so the
+   *  range is copied while the manager is locked. */
+  llvm::Optional<mdutils::Range> getValueRange(llvm::Value *v);
   void removeNoFloatTy(llvm::SmallPtrSetImpl<llvm::Value *>& res);
   void printAnnotatedObj(llvm::Module &m);
   
   void openPhiLoop(llvm::PHINode *phi);
+  void demotePhiPlaceholders(llvm::PHINode *phi);
   void closePhiLoops();
+  /** Assigns a wider fixed point type to the accumulators of the sum
+   *  reductions, so that they are converted only when leaving the loop. */
+  void widenReductions(std::vector<llvm::Value*> &vals);
   void sortQueue(std::vector<llvm::Value*> &vals);
   void cleanup(const std::vector<llvm::Value*>& queue);
+  /** Deletes the function clones made by the Initializer whose calls
+   *  have all been replaced by calls to their converted copies. */
+  void removeDeadClones(llvm::Module& m);
   void propagateCall(std::vector<llvm::Value *> &vals, llvm::SmallPtrSetImpl<llvm::Value *> &global);
-  llvm::Function *createFixFun(llvm::CallSite* call, bool *old);
+  llvm::Function *createFixFun(llvm::CallSite* call, llvm::Function *oldF, bool *old);
+  /** Promotes the indirect calls with floating point arguments or return
+   *  value to a chain of direct calls to the known possible callees,
+   *  which can then be converted, keeping the indirect call as fallback. */
+  void promoteIndirectCalls(std::vector<llvm::Value *> &vals);
+  /** Returns if an actual argument or the return value of a call is
+   *  converted to fixed point, so that promoting the call is worth it. */
+  bool hasConvertedInterface(llvm::CallSite call);
   void printConversionQueue(std::vector<llvm::Value*> vals);
+  void pruneColdCode(std::vector<llvm::Value*>& q);
+  void pruneUnprofitableRegions(std::vector<llvm::Value*>& q);
+  void collectPackableStructs(llvm::Module& m);
+  bool isLayoutConvertedValue(llvm::Value *v);
   void performConversion(llvm::Module& m, std::vector<llvm::Value*>& q);
   llvm::Value *convertSingleValue(llvm::Module& m, llvm::Value *val, FixedPointType& fixpt);
   
@@ -134,25 +303,67 @@ struct FloatToFixed : public llvm::ModulePass {
   llvm::Constant *convertConstant(llvm::Constant *flt, FixedPointType& fixpt, TypeMatchPolicy typepol);
   llvm::Constant *convertGlobalVariable(llvm::GlobalVariable *glob, FixedPointType& fixpt, TypeMatchPolicy typepol);
   llvm::Constant *convertConstantExpr(llvm::ConstantExpr *cexp, FixedPointType& fixpt, TypeMatchPolicy typepol);
+  /** Converts a constant of a struct type whose fields may have been
+   *  reordered, field by field with the fixed point type of each field.
+   *  @returns nullptr if a field does not match the converted struct */
+  llvm::Constant *convertPackableConstantStruct(llvm::ConstantStruct *strt, FixedPointType& fixpt);
   llvm::Constant *convertConstantAggregate(llvm::ConstantAggregate *cag, FixedPointType& fixpt, TypeMatchPolicy typepol);
   llvm::Constant *convertConstantDataSequential(llvm::ConstantDataSequential *, const FixedPointType&);
   template <class T> llvm::Constant *createConstantDataSequential(llvm::ConstantDataSequential *, const FixedPointType&);
   llvm::Constant *convertLiteral(llvm::ConstantFP *flt, llvm::Instruction *, FixedPointType&, TypeMatchPolicy typepol);
+  llvm::Constant *convertLiteralUncached(llvm::ConstantFP *flt, llvm::Instruction *, FixedPointType&, TypeMatchPolicy typepol);
   bool convertAPFloat(llvm::APFloat, llvm::APSInt&, llvm::Instruction *, const FixedPointType&);
   
   llvm::Value *convertInstruction(llvm::Module& m, llvm::Instruction *val, FixedPointType& fixpt);
-  llvm::Value *convertAlloca(llvm::AllocaInst *alloca, const FixedPointType& fixpt);
+  llvm::Value *convertAlloca(llvm::AllocaInst *alloca, FixedPointType& fixpt);
   llvm::Value *convertLoad(llvm::LoadInst *load, FixedPointType& fixpt);
   llvm::Value *convertStore(llvm::StoreInst *load);
   llvm::Value *convertGep(llvm::GetElementPtrInst *gep, FixedPointType& fixpt);
   llvm::Value *convertExtractValue(llvm::ExtractValueInst *exv, FixedPointType& fixpt);
   llvm::Value *convertInsertValue(llvm::InsertValueInst *inv, FixedPointType& fixpt);
   llvm::Value *convertPhi(llvm::PHINode *load, FixedPointType& fixpt);
+  /** Chooses the blocks where the conversions of the incoming values of
+   *  a phi are placed, splitting the critical edges if needed.
+   *  @param res On output, the block for each incoming value, or nullptr
+   *    if the value does not need any conversion code. */
+  void getPhiIncomingConversionBlocks(llvm::PHINode *phi, const FixedPointType& fixpt, llvm::SmallVectorImpl<llvm::BasicBlock *>& res);
+  bool needsConversionCode(llvm::Value *val, const FixedPointType& fixpt);
   llvm::Value *convertSelect(llvm::SelectInst *sel, FixedPointType& fixpt);
   llvm::Value *convertCall(llvm::CallSite *call, FixedPointType& fixpt);
   llvm::Value *convertRet(llvm::ReturnInst *ret, FixedPointType& fixpt);
   llvm::Value *convertBinOp(llvm::Instruction *instr, const FixedPointType& fixpt);
+  /** Converts an addition or subtraction in which at least one operand is
+   *  available in a wide format, normalizing only the result.
+   *  @returns nullptr if the instruction is not part of a chain. */
+  llvm::Value *convertFusedAdd(llvm::Instruction *instr, const FixedPointType& fixpt);
+  bool isFusableIntoAdd(llvm::Instruction *instr);
+  /** Converts a call to llvm.fmuladd or llvm.fma as a widening
+   *  multiplication followed by an addition with a single normalization. */
+  llvm::Value *convertMulAddIntrinsic(llvm::Instruction *call, const FixedPointType& fixpt);
+  /** Generates the product of two values in the double-width format.
+   *  @param prodtype On output, the fixed point type of the product. */
+  llvm::Value *genFixedPointWideMul(llvm::Value *op1, llvm::Value *op2, const FixedPointType& fixpt,
+    llvm::Instruction *ip, FixedPointType& prodtype);
+  /** Generates the sum or difference of two fixed point values in a format
+   *  which does not lose any of their bits, up to 64 bits.
+   *  @param sumtype On output, the fixed point type of the result.
+   *  @returns nullptr if that format would have less fractional bits
+   *    than fixpt. */
+  llvm::Value *genFixedPointWideAdd(llvm::Value *val1, const FixedPointType& type1, llvm::Value *val2, const FixedPointType& type2,
+    bool sub, const FixedPointType& fixpt, llvm::Instruction *ip, FixedPointType& sumtype);
+  /** Rescales the length of memcpy, memmove and memset calls on converted
+   *  buffers to the size of the converted elements, mutating the call. */
+  llvm::Value *convertMemIntrinsic(llvm::MemIntrinsic *memi);
+  /** Finds the converted buffer pointed by an operand of a memory intrinsic.
+   *  @param newptr On output, the converted pointer, or nullptr if the
+   *    buffer was not converted.
+   *  @returns false if the conversion of the buffer failed. */
+  bool matchMemIntrinsicPointer(llvm::Value *ptr, llvm::Value *&newptr, llvm::Type *&oldelemt, llvm::Type *&newelemt);
   llvm::Value *convertCmp(llvm::FCmpInst *fcmp);
+  /** Converts a comparison between a converted value and a floating point
+   *  constant by rounding the constant to the format of the value.
+   *  @returns nullptr if the comparison does not have this form. */
+  llvm::Value *convertCmpWithConstant(llvm::FCmpInst *fcmp);
   llvm::Value *convertCast(llvm::CastInst *cast, const FixedPointType& fixpt);
   llvm::Value *fallback(llvm::Instruction *unsupp, FixedPointType& fixpt);
   
@@ -324,6 +535,19 @@ struct FloatToFixed : public llvm::ModulePass {
    *    is an instruction or a constant.
    *  @returns The converted value. */
   llvm::Value *genConvertFixedToFixed(llvm::Value *fix, const FixedPointType& srct, const FixedPointType& destt, llvm::Instruction *ip = nullptr);
+  /** Records a new conversion site, if the instrumentation is enabled.
+   *  @param conv The result of the conversion; nothing is recorded if it
+   *    is not a new instruction.
+   *  @param origin The value whose debug location identifies the site. */
+  void instrumentConversion(llvm::Value *conv, llvm::Value *origin, ConversionSiteKind kind);
+  /** Inserts the increment of a runtime counter before every recorded
+   *  conversion which is still used, then creates the table of the
+   *  counters and registers it with the runtime at program startup. */
+  void finalizeConversionInstrumentation(llvm::Module& m);
+  /** Instruments the values collected by collectProfiledValues() with
+   *  lock-free trackers of their minimum and maximum, registered with the
+   *  runtime at program startup. */
+  void instrumentRanges(llvm::Module& m);
 
   /** Transforms a pre-existing LLVM type to a new LLVM
    *  type with integers instead of floating point depending on a
@@ -335,6 +559,37 @@ struct FloatToFixed : public llvm::ModulePass {
    *    fixed point was encountered.
    *  @returns The new LLVM type.  */
   llvm::Type *getLLVMFixedPointTypeForFloatType(llvm::Type *ftype, const FixedPointType& baset, bool *hasfloats = nullptr);
+  /** Returns the converted type for a struct whose converted fields
+   *  are elems, with the fields reordered by decreasing alignment if the
+   *  struct does not escape and if this reduces its size. */
+  llvm::Type *getPackedStructType(llvm::StructType *oldt, const FixedPointType& baset, llvm::ArrayRef<llvm::Type *> elems);
+  /** Returns the position of a field of an original struct in the
+   *  converted struct type t. */
+  unsigned remapStructIndex(llvm::StructType *t, unsigned idx);
+  /** Remaps the indices of an extractvalue or insertvalue instruction
+   *  on the converted aggregate type t. */
+  void remapAggregateIndices(llvm::Type *t, std::vector<unsigned>& idxlist);
+  /** Remaps the indices of a GEP on the converted pointer type t.
+   *  Struct indices are always constant integers. */
+  template <class T> void remapGEPIndices(llvm::Type *t, std::vector<T *>& idxlist) {
+    if (structFieldPermutation.empty() || idxlist.empty())
+      return;
+    for (unsigned i = 1; i < idxlist.size(); i++) {
+      if (t->isPointerTy()) {
+        t = t->getPointerElementType();
+      }
+      if (llvm::StructType *st = llvm::dyn_cast<llvm::StructType>(t)) {
+        llvm::ConstantInt *c = llvm::cast<llvm::ConstantInt>(idxlist[i]);
+        unsigned newidx = remapStructIndex(st, c->getZExtValue());
+        idxlist[i] = llvm::ConstantInt::get(c->getType(), newidx);
+        t = st->getElementType(newidx);
+      } else if (t->isArrayTy()) {
+        t = t->getArrayElementType();
+      } else if (t->isVectorTy()) {
+        t = t->getVectorElementType();
+      }
+    }
+  }
   
   llvm::Instruction *getFirstInsertionPointAfter(llvm::Instruction *i) {
     llvm::Instruction *ip = i->getNextNode();
@@ -349,6 +604,20 @@ struct FloatToFixed : public llvm::ModulePass {
   
   llvm::Type *getLLVMFixedPointTypeForFloatValue(llvm::Value *val);
   
+  /** Chooses a storage format for an array narrower than the one used for
+   *  computation, if allowed by the range of the array and by its uses.
+   *  @param memobj An alloca or a global variable.
+   *  @param fixpt The fixed point type assigned to the array elements.
+   *  @param storaget On output, the storage format if narrowing is possible.
+   *  @returns true if the array shall be stored in the format storaget. */
+  bool getNarrowStorageType(llvm::Value *memobj, const FixedPointType& fixpt, FixedPointType& storaget);
+  /** Returns an alignment suitable for vector loads from an object of
+   *  type t, never lower than oldalign. */
+  unsigned getVectorFriendlyAlignment(llvm::Type *t, llvm::Function *f, unsigned oldalign);
+  /** Returns the smallest integer width legal for the target of f which
+   *  can hold bits bits, or bits itself if no rounding is requested. */
+  int getLegalIntegerWidth(int bits, llvm::Function *f);
+  
   std::shared_ptr<ValueInfo> newValueInfo(llvm::Value *val) {
     LLVM_DEBUG(llvm::dbgs() << "new valueinfo for " << *val << "\n");
     auto vi = info.find(val);
@@ -483,6 +752,7 @@ struct FloatToFixed : public llvm::ModulePass {
     using namespace llvm;
     using namespace mdutils;
 
+    std::lock_guard<std::recursive_mutex> mdlock(getMetadataManagerMutex());
     MetadataManager& mdmgr = MetadataManager::getMetadataManager();
     InputInfo* ii = dyn_cast_or_null<InputInfo>(mdmgr.retrieveMDInfo(v));
     if (!ii)
@@ -505,6 +775,7 @@ struct FloatToFixed : public llvm::ModulePass {
     if (!isa<Constant>(op))
       return;
 
+    std::lock_guard<std::recursive_mutex> mdlock(getMetadataManagerMutex());
     MetadataManager& mdmgr = MetadataManager::getMetadataManager();
     SmallVector<InputInfo *, 2U> cinfo;
     mdmgr.retrieveConstInfo(*i, cinfo);
@@ -521,6 +792,17 @@ struct FloatToFixed : public llvm::ModulePass {
   }
 
   int getLoopNestingLevelOfValue(llvm::Value *v);
+  /** Returns the estimated number of executions of a value per execution of
+   *  the function it belongs to. Uses the block frequencies when the function
+   *  has profile data, 2^loopDepth otherwise. */
+  double getExecutionWeightOfValue(llvm::Value *v);
+  void computeBlockWeights(llvm::Function *f);
+  /** Returns the loop nest of f as it was before the first query */
+  const LoopNest& getLoopNest(llvm::Function *f);
+  static LoopNest buildLoopNest(llvm::Function *f, llvm::LoopInfo& li);
+  /** Returns if a function is cold according to the profile summary.
+   *  Always false when no profile is available. */
+  bool isColdFunction(llvm::Function *f);
 };
 
 
@@ -21,6 +21,7 @@ using namespace taffo;
 
 void FloatToFixed::readGlobalMetadata(Module &m, SmallPtrSetImpl<Value *> &variables, bool functionAnnotation)
 {
+  std::lock_guard<std::recursive_mutex> mdlock(getMetadataManagerMutex());
   MetadataManager &MDManager = MetadataManager::getMetadataManager();
   
   for (GlobalVariable &gv : m.globals()) {
@@ -36,6 +37,7 @@ void FloatToFixed::readGlobalMetadata(Module &m, SmallPtrSetImpl<Value *> &varia
 
 void FloatToFixed::readLocalMetadata(Function &f, SmallPtrSetImpl<Value *> &variables, bool argumentsOnly)
 {
+  std::lock_guard<std::recursive_mutex> mdlock(getMetadataManagerMutex());
   MetadataManager &MDManager = MetadataManager::getMetadataManager();
 
   SmallVector<mdutils::MDInfo*, 5> argsII;
@@ -127,6 +129,24 @@ bool FloatToFixed::parseMetaData(SmallPtrSetImpl<Value *> *variables, MDInfo *ra
 }
 
 
+Optional<Range> FloatToFixed::getValueRange(Value *v)
+{
+  auto cached = valueRanges.find(v);
+  if (cached != valueRanges.end())
+    return cached->second;
+
+  Optional<Range> res;
+  {
+    std::lock_guard<std::recursive_mutex> mdlock(getMetadataManagerMutex());
+    InputInfo *ii = dyn_cast_or_null<InputInfo>(MetadataManager::getMetadataManager().retrieveMDInfo(v));
+    if (ii && ii->IRange)
+      res = *ii->IRange;
+  }
+  valueRanges[v] = res;
+  return res;
+}
+
+
 void FloatToFixed::removeNoFloatTy(SmallPtrSetImpl<Value *> &res)
 {
   for (auto it: res) {
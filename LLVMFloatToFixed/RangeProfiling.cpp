@@ -0,0 +1,175 @@
+#include <algorithm>
+#include <cstdint>
+#include <sstream>
+#include "llvm/Pass.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+#include "LLVMFloatToFixedPass.h"
+
+using namespace llvm;
+using namespace flttofix;
+using namespace mdutils;
+
+
+static bool isProfiledInfo(MDInfo *mdi)
+{
+  InputInfo *ii = dyn_cast_or_null<InputInfo>(mdi);
+  return ii && ii->IRange && ii->IEnableConversion;
+}
+
+
+void flttofix::collectProfiledValues(Module& m, std::vector<Value *>& res)
+{
+  std::lock_guard<std::recursive_mutex> mdlock(getMetadataManagerMutex());
+  MetadataManager& mdmgr = MetadataManager::getMetadataManager();
+  for (Function& f: m) {
+    if (f.isDeclaration())
+      continue;
+
+    SmallVector<MDInfo *, 5> argsii;
+    mdmgr.retrieveArgumentInputInfo(f, argsii);
+    for (unsigned i = 0; i < argsii.size() && i < f.arg_size(); i++) {
+      Argument *arg = f.getArg(i);
+      if (arg->getType()->isFloatingPointTy() && isProfiledInfo(argsii[i]))
+        res.push_back(arg);
+    }
+
+    for (Instruction& i: instructions(f)) {
+      if (!i.getType()->isFloatingPointTy() || i.isTerminator())
+        continue;
+      if (isProfiledInfo(mdmgr.retrieveMDInfo(&i)))
+        res.push_back(&i);
+    }
+  }
+}
+
+
+/* Maps a double to an integer with the same ordering */
+Error flttofix::mergeRangeProfile(StringRef profile, StringRef source, StringRef module, size_t numvals,
+  std::map<size_t, ObservedRange>& ranges)
+{
+  const StringRef keyword = "module ";
+  SmallVector<StringRef, 64> lines;
+  profile.split(lines, '\n', -1, false);
+
+  bool current = false;
+  for (StringRef line: lines) {
+    auto malformed = [&]() {
+      return make_error<StringError>(source + ": malformed line \"" + line + "\"", inconvertibleErrorCode());
+    };
+    if (line.startswith(keyword)) {
+      /* the name of the module may contain spaces or be empty, thus the
+       * number of values is the last field */
+      StringRef fields = line.drop_front(keyword.size()).rtrim();
+      size_t sep = fields.rfind(' ');
+      size_t n;
+      if (sep == StringRef::npos || fields.substr(sep + 1).getAsInteger(10, n))
+        return malformed();
+      current = fields.substr(0, sep) == module;
+      if (current && n != numvals)
+        return make_error<StringError>(source + ": the profile of " + module + " has " + std::to_string(n) +
+          " values instead of " + std::to_string(numvals) + "; was it made from this module?", inconvertibleErrorCode());
+      continue;
+    }
+    if (!current)
+      continue;
+    std::istringstream linestream(line.str());
+    size_t id;
+    double min, max;
+    if (!(linestream >> id >> min >> max) || id >= numvals)
+      return malformed();
+    auto it = ranges.find(id);
+    if (it == ranges.end()) {
+      ranges[id] = ObservedRange(min, max);
+    } else {
+      it->second.first = std::min(it->second.first, min);
+      it->second.second = std::max(it->second.second, max);
+    }
+  }
+  return Error::success();
+}
+
+
+static Value *genOrderedKey(IRBuilder<>& builder, Value *dbl)
+{
+  Type *i64 = builder.getInt64Ty();
+  Value *bits = builder.CreateBitCast(dbl, i64);
+  Value *negkey = builder.CreateXor(bits, ConstantInt::get(i64, INT64_MAX));
+  return builder.CreateSelect(builder.CreateICmpSLT(bits, ConstantInt::get(i64, 0)), negkey, bits);
+}
+
+
+void FloatToFixed::instrumentRanges(Module& m)
+{
+  std::vector<Value *> vals;
+  collectProfiledValues(m, vals);
+  if (vals.empty())
+    return;
+
+  LLVMContext& ctxt = m.getContext();
+  Type *i64 = Type::getInt64Ty(ctxt);
+  Constant *empty = ConstantInt::get(i64, INT64_MAX);
+  Constant *emptymax = ConstantInt::get(i64, INT64_MIN);
+
+  /* one (min, max) pair per value, initialized to an empty range */
+  ArrayType *entryt = ArrayType::get(i64, 2);
+  ArrayType *tablet = ArrayType::get(entryt, vals.size());
+  Constant *emptyentry = ConstantArray::get(entryt, {empty, emptymax});
+  std::vector<Constant *> entries(vals.size(), emptyentry);
+  GlobalVariable *table = new GlobalVariable(m, tablet, false, GlobalValue::InternalLinkage,
+    ConstantArray::get(tablet, entries), "taffo.range.table");
+
+  for (unsigned id = 0; id < vals.size(); id++) {
+    Value *v = vals[id];
+    Instruction *ip;
+    if (Argument *arg = dyn_cast<Argument>(v))
+      ip = &(*arg->getParent()->getEntryBlock().getFirstInsertionPt());
+    else
+      ip = getFirstInsertionPointAfter(cast<Instruction>(v));
+    if (!ip)
+      continue;
+
+    IRBuilder<> builder(ip);
+    if (Instruction *i = dyn_cast<Instruction>(v))
+      builder.SetCurrentDebugLocation(i->getDebugLoc());
+    Value *dbl = builder.CreateFPCast(v, builder.getDoubleTy());
+    Value *key = genOrderedKey(builder, dbl);
+    /* NaNs do not belong to any range */
+    Value *isnan = builder.CreateFCmpUNO(v, v);
+    Value *minkey = builder.CreateSelect(isnan, empty, key);
+    Value *maxkey = builder.CreateSelect(isnan, emptymax, key);
+    Constant *minidx[] = {ConstantInt::get(i64, 0), ConstantInt::get(i64, id), ConstantInt::get(i64, 0)};
+    Constant *maxidx[] = {ConstantInt::get(i64, 0), ConstantInt::get(i64, id), ConstantInt::get(i64, 1)};
+    builder.CreateAtomicRMW(AtomicRMWInst::Min, ConstantExpr::getGetElementPtr(tablet, table, minidx),
+      minkey, AtomicOrdering::Monotonic);
+    builder.CreateAtomicRMW(AtomicRMWInst::Max, ConstantExpr::getGetElementPtr(tablet, table, maxidx),
+      maxkey, AtomicOrdering::Monotonic);
+  }
+
+  Constant *modname = ConstantDataArray::getString(ctxt, m.getSourceFileName());
+  GlobalVariable *modnamegv = new GlobalVariable(m, modname->getType(), true, GlobalValue::PrivateLinkage,
+    modname, "taffo.range.module");
+  Type *i8ptr = Type::getInt8PtrTy(ctxt);
+  FunctionCallee regfun = m.getOrInsertFunction("__taffo_range_register", Type::getVoidTy(ctxt),
+    i64->getPointerTo(), i64, i8ptr);
+  Function *ctor = Function::Create(FunctionType::get(Type::getVoidTy(ctxt), false),
+    GlobalValue::InternalLinkage, "taffo.range.init", &m);
+  IRBuilder<> builder(BasicBlock::Create(ctxt, "entry", ctor));
+  builder.CreateCall(regfun, {
+    ConstantExpr::getPointerCast(table, i64->getPointerTo()),
+    ConstantInt::get(i64, vals.size()),
+    ConstantExpr::getPointerCast(modnamegv, i8ptr)});
+  builder.CreateRetVoid();
+  appendToGlobalCtors(m, ctor, 65535);
+
+  LLVM_DEBUG(dbgs() << "instrumented the range of " << vals.size() << " values\n");
+  ProfiledValueCount += vals.size();
+  result.profiledValues += vals.size();
+}
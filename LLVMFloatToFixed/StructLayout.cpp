@@ -0,0 +1,244 @@
+#include <algorithm>
+#include "llvm/Pass.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+#include "LLVMFloatToFixedPass.h"
+#include "TypeUtils.h"
+
+using namespace llvm;
+using namespace flttofix;
+using namespace taffo;
+
+
+/* Collects all the struct types contained in a type */
+static void collectStructTypes(Type *t, SmallPtrSetImpl<StructType *>& res)
+{
+  if (t->isPointerTy()) {
+    collectStructTypes(t->getPointerElementType(), res);
+  } else if (t->isArrayTy()) {
+    collectStructTypes(t->getArrayElementType(), res);
+  } else if (t->isVectorTy()) {
+    collectStructTypes(t->getVectorElementType(), res);
+  } else if (StructType *st = dyn_cast<StructType>(t)) {
+    if (!res.insert(st).second)
+      return;
+    for (Type *elemt: st->elements())
+      collectStructTypes(elemt, res);
+  }
+}
+
+
+/* Returns if an instruction accesses struct-typed memory only through
+ * operations whose indices can be rewritten */
+static bool isLayoutIndependentUse(Instruction *i)
+{
+  if (isa<AllocaInst>(i) || isa<LoadInst>(i) || isa<StoreInst>(i) ||
+      isa<GetElementPtrInst>(i) || isa<ExtractValueInst>(i) ||
+      isa<InsertValueInst>(i) || isa<PHINode>(i) || isa<SelectInst>(i))
+    return true;
+  if (isa<BitCastInst>(i)) {
+    /* annotations and lifetime markers do not access the memory */
+    for (User *u: i->users()) {
+      CallInst *call = dyn_cast<CallInst>(u);
+      Function *callee = call ? call->getCalledFunction() : nullptr;
+      if (!callee)
+        return false;
+      if (callee->getName() != "llvm.var.annotation" &&
+          callee->getIntrinsicID() != Intrinsic::lifetime_start &&
+          callee->getIntrinsicID() != Intrinsic::lifetime_end)
+        return false;
+    }
+    return true;
+  }
+  return false;
+}
+
+
+bool FloatToFixed::isLayoutConvertedValue(Value *v)
+{
+  if (isa<Instruction>(v) || isa<GlobalVariable>(v)) {
+    if (!hasInfo(v))
+      return false;
+    std::shared_ptr<ValueInfo> vi = valueInfo(v);
+    return !vi->noTypeConversion && !vi->fixpType.isInvalid();
+  }
+  if (isa<Constant>(v))
+    return !isa<GlobalValue>(v) && !isa<ConstantExpr>(v);
+  return false;
+}
+
+
+void FloatToFixed::collectPackableStructs(Module& m)
+{
+  if (!options.packStructs)
+    return;
+
+  SmallPtrSet<StructType *, 8> candidates;
+  for (auto& vi: info) {
+    if (!vi.second->noTypeConversion)
+      collectStructTypes(vi.first->getType(), candidates);
+  }
+  if (candidates.empty())
+    return;
+
+  SmallPtrSet<StructType *, 8> escaping;
+  for (GlobalVariable& gv: m.globals()) {
+    SmallPtrSet<StructType *, 4> types;
+    collectStructTypes(gv.getType(), types);
+    if (types.empty())
+      continue;
+    bool ok = isLayoutConvertedValue(&gv);
+    for (User *u: gv.users()) {
+      if (!isa<Instruction>(u))
+        ok = false;
+    }
+    if (!ok)
+      escaping.insert(types.begin(), types.end());
+  }
+
+  for (Function& f: m.functions()) {
+    /* the structs in the signatures are fixed at function cloning time */
+    collectStructTypes(f.getFunctionType(), escaping);
+
+    auto oldf = functionPool.find(&f);
+    if (oldf != functionPool.end() && oldf->second)
+      /* the body of this function will be dropped */
+      continue;
+
+    for (Instruction& i: instructions(f)) {
+      SmallPtrSet<StructType *, 4> types;
+      bool ok = isLayoutIndependentUse(&i);
+      collectStructTypes(i.getType(), types);
+      if (!types.empty())
+        ok = ok && isLayoutConvertedValue(&i);
+      for (Value *op: i.operands()) {
+        SmallPtrSet<StructType *, 4> optypes;
+        collectStructTypes(op->getType(), optypes);
+        if (optypes.empty())
+          continue;
+        ok = ok && isLayoutConvertedValue(op);
+        types.insert(optypes.begin(), optypes.end());
+      }
+      if (!ok)
+        escaping.insert(types.begin(), types.end());
+    }
+  }
+
+  /* a struct is laid out in memory as part of the structs which contain it */
+  SmallVector<StructType *, 8> worklist(escaping.begin(), escaping.end());
+  while (!worklist.empty()) {
+    StructType *st = worklist.pop_back_val();
+    SmallPtrSet<StructType *, 4> nested;
+    collectStructTypes(st, nested);
+    for (StructType *nst: nested) {
+      if (escaping.insert(nst).second)
+        worklist.push_back(nst);
+    }
+  }
+
+  for (StructType *st: candidates) {
+    if (!escaping.count(st)) {
+      LLVM_DEBUG(dbgs() << "struct " << *st << " does not escape; its layout can be optimized\n");
+      packableStructs.insert(st);
+    }
+  }
+
+  /* the converted placeholders of the phis were created with the
+   * original layout */
+  for (auto& data: phiReplacementData) {
+    PHIInfo& phiinfo = data.second;
+    if (phiinfo.placeh_conv == phiinfo.placeh_noconv)
+      continue;
+    Type *newt = getLLVMFixedPointTypeForFloatType(data.first->getType(), fixPType(data.first));
+    if (newt == phiinfo.placeh_conv->getType())
+      continue;
+    LoadInst *oldplaceh = cast<LoadInst>(phiinfo.placeh_conv);
+    Instruction *oldalloca = cast<Instruction>(oldplaceh->getPointerOperand());
+    Value *newplaceh = createPlaceholder(newt, data.first->getParent(), "phi_conv");
+    *(newValueInfo(newplaceh)) = *(valueInfo(oldplaceh));
+    cpMetaData(newplaceh, data.first);
+    info.erase(oldplaceh);
+    oldplaceh->eraseFromParent();
+    oldalloca->eraseFromParent();
+    phiinfo.placeh_conv = newplaceh;
+    operandPool[phiinfo.placeh_noconv] = newplaceh;
+  }
+}
+
+
+Type *FloatToFixed::getPackedStructType(StructType *oldt, const FixedPointType& baset, ArrayRef<Type *> elems)
+{
+  auto key = std::make_pair(oldt, baset.toString());
+  auto cached = packedStructTypes.find(key);
+  if (cached != packedStructTypes.end())
+    return cached->second;
+
+  /* placing the fields by decreasing alignment eliminates all the padding
+   * between them */
+  SmallVector<unsigned, 8> order;
+  for (unsigned i = 0; i < elems.size(); i++)
+    order.push_back(i);
+  std::stable_sort(order.begin(), order.end(), [&](unsigned a, unsigned b) {
+    return dataLayout->getABITypeAlignment(elems[a]) > dataLayout->getABITypeAlignment(elems[b]);
+  });
+  SmallVector<Type *, 8> newelems;
+  for (unsigned i: order)
+    newelems.push_back(elems[i]);
+
+  LLVMContext& ctxt = oldt->getContext();
+  Type *unpacked = StructType::get(ctxt, elems, oldt->isPacked());
+  uint64_t oldsize = dataLayout->getTypeAllocSize(unpacked);
+  uint64_t newsize = dataLayout->getTypeAllocSize(StructType::get(ctxt, newelems, oldt->isPacked()));
+  if (newsize >= oldsize) {
+    packedStructTypes[key] = unpacked;
+    return unpacked;
+  }
+
+  std::string name = oldt->hasName() ? oldt->getName().str() : std::string("struct");
+  StructType *newt = StructType::create(ctxt, newelems, name + ".fixp", oldt->isPacked());
+  SmallVector<unsigned, 8>& perm = structFieldPermutation[newt];
+  perm.resize(elems.size());
+  for (unsigned i = 0; i < order.size(); i++)
+    perm[order[i]] = i;
+
+  LLVM_DEBUG(dbgs() << "reordered fields of " << *oldt << " into " << *newt << " (" << oldsize << " -> " << newsize << " bytes)\n");
+  PackedStructCount++;
+  result.packedStructs++;
+  packedStructTypes[key] = newt;
+  return newt;
+}
+
+
+unsigned FloatToFixed::remapStructIndex(StructType *t, unsigned idx)
+{
+  auto perm = structFieldPermutation.find(t);
+  if (perm == structFieldPermutation.end())
+    return idx;
+  return perm->second[idx];
+}
+
+
+void FloatToFixed::remapAggregateIndices(Type *t, std::vector<unsigned>& idxlist)
+{
+  if (structFieldPermutation.empty())
+    return;
+  for (unsigned& idx: idxlist) {
+    if (t->isArrayTy()) {
+      t = t->getArrayElementType();
+    } else if (t->isVectorTy()) {
+      t = t->getVectorElementType();
+    } else if (StructType *st = dyn_cast<StructType>(t)) {
+      idx = remapStructIndex(st, idx);
+      t = st->getElementType(idx);
+    }
+  }
+}
@@ -0,0 +1,37 @@
+/* Black-Scholes pricing of 32 European call options; the inputs are
+ * (spot, strike, rate, volatility, time) for each option */
+
+#include <math.h>
+
+#define OPTIONS 32
+
+
+/* Abramowitz-Stegun approximation of the standard normal CDF */
+static float cndf(float __attribute__((annotate("scalar(range(-8, 8))"))) x)
+{
+  float __attribute__((annotate("scalar(range(0, 8))"))) ax = fabsf(x);
+  float __attribute__((annotate("scalar(range(0, 1))"))) k = 1.0f / (1.0f + 0.2316419f * ax);
+  float __attribute__((annotate("scalar(range(0, 1))"))) n = 0.3989423f * expf(-0.5f * ax * ax);
+  float __attribute__((annotate("scalar(range(-1, 1))"))) poly =
+    k * (0.3193815f + k * (-0.3565638f + k * (1.7814779f + k * (-1.8212560f + k * 1.3302744f))));
+  float __attribute__((annotate("scalar(range(0, 1))"))) res = 1.0f - n * poly;
+  return x < 0.0f ? 1.0f - res : res;
+}
+
+
+void kernel(float *in, float *out)
+{
+  for (int i = 0; i < OPTIONS; i++) {
+    float __attribute__((annotate("scalar(range(10, 100))"))) s = in[5 * i];
+    float __attribute__((annotate("scalar(range(10, 100))"))) k = in[5 * i + 1];
+    float __attribute__((annotate("scalar(range(0, 0.1))"))) r = in[5 * i + 2];
+    float __attribute__((annotate("scalar(range(0.05, 0.6))"))) v = in[5 * i + 3];
+    float __attribute__((annotate("scalar(range(0.1, 2))"))) t = in[5 * i + 4];
+
+    float __attribute__((annotate("scalar(range(0, 1.5))"))) sqrtt = sqrtf(t);
+    float __attribute__((annotate("scalar(range(-8, 8))"))) d1 = (logf(s / k) + (r + 0.5f * v * v) * t) / (v * sqrtt);
+    float __attribute__((annotate("scalar(range(-8, 8))"))) d2 = d1 - v * sqrtt;
+    float __attribute__((annotate("scalar(range(0, 100))"))) price = s * cndf(d1) - k * expf(-r * t) * cndf(d2);
+    out[i] = price;
+  }
+}
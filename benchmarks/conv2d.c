@@ -0,0 +1,28 @@
+/* 3x3 Gaussian blur of a 32x32 image (valid region only) */
+
+#define W 32
+#define H 32
+#define K 3
+
+static const float filter[K][K] __attribute__((annotate("scalar()"))) = {
+  { 0.0625f, 0.125f, 0.0625f },
+  { 0.125f,  0.25f,  0.125f  },
+  { 0.0625f, 0.125f, 0.0625f }
+};
+
+
+void kernel(float *in, float *out)
+{
+  for (int y = 0; y < H - K + 1; y++) {
+    for (int x = 0; x < W - K + 1; x++) {
+      float __attribute__((annotate("scalar(range(0, 1))"))) acc = 0.0f;
+      for (int ky = 0; ky < K; ky++) {
+        for (int kx = 0; kx < K; kx++) {
+          float __attribute__((annotate("scalar(range(0, 1))"))) px = in[(y + ky) * W + x + kx];
+          acc += filter[ky][kx] * px;
+        }
+      }
+      out[y * (W - K + 1) + x] = acc;
+    }
+  }
+}
@@ -0,0 +1,64 @@
+/* 64-point radix-2 decimation in time FFT; the inputs and the outputs are
+ * interleaved real and imaginary parts */
+
+#define N 64
+#define LOGN 6
+
+static const float twr[N / 2] __attribute__((annotate("scalar()"))) = {
+  1.0000000f, 0.9951847f, 0.9807853f, 0.9569403f, 0.9238795f, 0.8819213f, 0.8314696f, 0.7730105f,
+  0.7071068f, 0.6343933f, 0.5555702f, 0.4713967f, 0.3826834f, 0.2902847f, 0.1950903f, 0.0980171f,
+  0.0000000f, -0.0980171f, -0.1950903f, -0.2902847f, -0.3826834f, -0.4713967f, -0.5555702f, -0.6343933f,
+  -0.7071068f, -0.7730105f, -0.8314696f, -0.8819213f, -0.9238795f, -0.9569403f, -0.9807853f, -0.9951847f
+};
+static const float twi[N / 2] __attribute__((annotate("scalar()"))) = {
+  0.0000000f, -0.0980171f, -0.1950903f, -0.2902847f, -0.3826834f, -0.4713967f, -0.5555702f, -0.6343933f,
+  -0.7071068f, -0.7730105f, -0.8314696f, -0.8819213f, -0.9238795f, -0.9569403f, -0.9807853f, -0.9951847f,
+  -1.0000000f, -0.9951847f, -0.9807853f, -0.9569403f, -0.9238795f, -0.8819213f, -0.8314696f, -0.7730105f,
+  -0.7071068f, -0.6343933f, -0.5555702f, -0.4713967f, -0.3826834f, -0.2902847f, -0.1950903f, -0.0980171f
+};
+
+
+static unsigned reverse(unsigned i)
+{
+  unsigned r = 0;
+  for (int b = 0; b < LOGN; b++) {
+    r = (r << 1) | (i & 1);
+    i >>= 1;
+  }
+  return r;
+}
+
+
+void kernel(float *in, float *out)
+{
+  float __attribute__((annotate("scalar(range(-64, 64))"))) re[N];
+  float __attribute__((annotate("scalar(range(-64, 64))"))) im[N];
+
+  for (unsigned i = 0; i < N; i++) {
+    unsigned j = reverse(i);
+    re[j] = in[2 * i];
+    im[j] = in[2 * i + 1];
+  }
+
+  for (int len = 2; len <= N; len <<= 1) {
+    int half = len / 2;
+    int step = N / len;
+    for (int base = 0; base < N; base += len) {
+      for (int k = 0; k < half; k++) {
+        int p = base + k;
+        int q = p + half;
+        float __attribute__((annotate("scalar(range(-64, 64))"))) tr = twr[k * step] * re[q] - twi[k * step] * im[q];
+        float __attribute__((annotate("scalar(range(-64, 64))"))) ti = twr[k * step] * im[q] + twi[k * step] * re[q];
+        re[q] = re[p] - tr;
+        im[q] = im[p] - ti;
+        re[p] = re[p] + tr;
+        im[p] = im[p] + ti;
+      }
+    }
+  }
+
+  for (int i = 0; i < N; i++) {
+    out[2 * i] = re[i];
+    out[2 * i + 1] = im[i];
+  }
+}
@@ -0,0 +1,22 @@
+/* 16-tap low-pass FIR filter over 256 samples */
+
+#define N 256
+#define TAPS 16
+
+static const float coeff[TAPS] __attribute__((annotate("scalar()"))) = {
+  -0.0018f, -0.0066f, -0.0110f, 0.0053f, 0.0541f, 0.1286f, 0.1966f, 0.2348f,
+  0.2348f, 0.1966f, 0.1286f, 0.0541f, 0.0053f, -0.0110f, -0.0066f, -0.0018f
+};
+
+
+void kernel(float *in, float *out)
+{
+  for (int i = 0; i < N; i++) {
+    float __attribute__((annotate("scalar(range(-2, 2))"))) acc = 0.0f;
+    for (int j = 0; j < TAPS; j++) {
+      float __attribute__((annotate("scalar(range(-1, 1))"))) x = i - j >= 0 ? in[i - j] : 0.0f;
+      acc += coeff[j] * x;
+    }
+    out[i] = acc;
+  }
+}
@@ -0,0 +1,19 @@
+/* 16x16 matrix product; the inputs are A followed by B, row major */
+
+#define N 16
+
+
+void kernel(float *in, float *out)
+{
+  for (int i = 0; i < N; i++) {
+    for (int j = 0; j < N; j++) {
+      float __attribute__((annotate("scalar(range(-16, 16))"))) acc = 0.0f;
+      for (int k = 0; k < N; k++) {
+        float __attribute__((annotate("scalar(range(-1, 1))"))) a = in[i * N + k];
+        float __attribute__((annotate("scalar(range(-1, 1))"))) b = in[N * N + k * N + j];
+        acc += a * b;
+      }
+      out[i * N + j] = acc;
+    }
+  }
+}
@@ -0,0 +1,36 @@
+/* Two cascaded biquad sections (direct form I) over 256 samples */
+
+#define N 256
+#define SECTIONS 2
+
+static const float b[SECTIONS][3] __attribute__((annotate("scalar()"))) = {
+  { 0.0675f, 0.1349f, 0.0675f },
+  { 0.0675f, 0.1349f, 0.0675f }
+};
+static const float a[SECTIONS][2] __attribute__((annotate("scalar()"))) = {
+  { -1.1430f, 0.4128f },
+  { -1.1430f, 0.4128f }
+};
+
+
+void kernel(float *in, float *out)
+{
+  float __attribute__((annotate("scalar(range(-4, 4))"))) x1[SECTIONS] = { 0.0f, 0.0f };
+  float __attribute__((annotate("scalar(range(-4, 4))"))) x2[SECTIONS] = { 0.0f, 0.0f };
+  float __attribute__((annotate("scalar(range(-4, 4))"))) y1[SECTIONS] = { 0.0f, 0.0f };
+  float __attribute__((annotate("scalar(range(-4, 4))"))) y2[SECTIONS] = { 0.0f, 0.0f };
+
+  for (int i = 0; i < N; i++) {
+    float __attribute__((annotate("scalar(range(-4, 4))"))) x = in[i];
+    for (int s = 0; s < SECTIONS; s++) {
+      float __attribute__((annotate("scalar(range(-4, 4))"))) y =
+        b[s][0] * x + b[s][1] * x1[s] + b[s][2] * x2[s] - a[s][0] * y1[s] - a[s][1] * y2[s];
+      x2[s] = x1[s];
+      x1[s] = x;
+      y2[s] = y1[s];
+      y1[s] = y;
+      x = y;
+    }
+    out[i] = x;
+  }
+}
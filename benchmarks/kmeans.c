@@ -0,0 +1,59 @@
+/* K-means clustering of 64 2D points into 4 clusters; the inputs are the
+ * interleaved coordinates of the points, the outputs are the interleaved
+ * coordinates of the centroids */
+
+#define POINTS 64
+#define CLUSTERS 4
+#define ITERATIONS 8
+
+
+void kernel(float *in, float *out)
+{
+  float __attribute__((annotate("scalar(range(-1, 1))"))) cx[CLUSTERS];
+  float __attribute__((annotate("scalar(range(-1, 1))"))) cy[CLUSTERS];
+  int assign[POINTS];
+
+  for (int c = 0; c < CLUSTERS; c++) {
+    cx[c] = in[2 * c];
+    cy[c] = in[2 * c + 1];
+  }
+
+  for (int it = 0; it < ITERATIONS; it++) {
+    for (int p = 0; p < POINTS; p++) {
+      float __attribute__((annotate("scalar(range(-1, 1))"))) px = in[2 * p];
+      float __attribute__((annotate("scalar(range(-1, 1))"))) py = in[2 * p + 1];
+      float __attribute__((annotate("scalar(range(0, 8))"))) best = 8.0f;
+      int bestc = 0;
+      for (int c = 0; c < CLUSTERS; c++) {
+        float __attribute__((annotate("scalar(range(-2, 2))"))) dx = px - cx[c];
+        float __attribute__((annotate("scalar(range(-2, 2))"))) dy = py - cy[c];
+        float __attribute__((annotate("scalar(range(0, 8))"))) d = dx * dx + dy * dy;
+        if (d < best) {
+          best = d;
+          bestc = c;
+        }
+      }
+      assign[p] = bestc;
+    }
+
+    float __attribute__((annotate("scalar(range(-64, 64))"))) sx[CLUSTERS] = { 0.0f };
+    float __attribute__((annotate("scalar(range(-64, 64))"))) sy[CLUSTERS] = { 0.0f };
+    int count[CLUSTERS] = { 0 };
+    for (int p = 0; p < POINTS; p++) {
+      sx[assign[p]] += in[2 * p];
+      sy[assign[p]] += in[2 * p + 1];
+      count[assign[p]]++;
+    }
+    for (int c = 0; c < CLUSTERS; c++) {
+      if (count[c] > 0) {
+        cx[c] = sx[c] / count[c];
+        cy[c] = sy[c] / count[c];
+      }
+    }
+  }
+
+  for (int c = 0; c < CLUSTERS; c++) {
+    out[2 * c] = cx[c];
+    out[2 * c + 1] = cy[c];
+  }
+}
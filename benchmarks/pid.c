@@ -0,0 +1,34 @@
+/* PID controller driving a first order plant for 256 steps; the inputs are
+ * the setpoints, the outputs are the plant outputs */
+
+#define STEPS 256
+
+static const float kp __attribute__((annotate("scalar()"))) = 1.2f;
+static const float ki __attribute__((annotate("scalar()"))) = 0.35f;
+static const float kd __attribute__((annotate("scalar()"))) = 0.05f;
+static const float dt __attribute__((annotate("scalar()"))) = 0.01f;
+/* plant: y' = (u - y) / tau */
+static const float tau __attribute__((annotate("scalar()"))) = 0.2f;
+
+
+void kernel(float *in, float *out)
+{
+  float __attribute__((annotate("scalar(range(-10, 10))"))) y = 0.0f;
+  float __attribute__((annotate("scalar(range(-50, 50))"))) integral = 0.0f;
+  float __attribute__((annotate("scalar(range(-20, 20))"))) preverr = 0.0f;
+
+  for (int i = 0; i < STEPS; i++) {
+    float __attribute__((annotate("scalar(range(-5, 5))"))) setpoint = in[i];
+    float __attribute__((annotate("scalar(range(-20, 20))"))) err = setpoint - y;
+    integral += err * dt;
+    float __attribute__((annotate("scalar(range(-2000, 2000))"))) deriv = (err - preverr) / dt;
+    float __attribute__((annotate("scalar(range(-150, 150))"))) u = kp * err + ki * integral + kd * deriv;
+    if (u > 10.0f)
+      u = 10.0f;
+    else if (u < -10.0f)
+      u = -10.0f;
+    y += (u - y) * (dt / tau);
+    preverr = err;
+    out[i] = y;
+  }
+}
@@ -0,0 +1,108 @@
+/* Runtime of the conversion counters inserted by the float to fixed point
+ * conversion with -fixp-instrument-conversions.
+ *
+ * Every instrumented module registers its table of counters at startup.
+ * At exit, the counters of all the modules are written to the file named by
+ * the TAFFO_CONVERSION_PROFILE environment variable (taffo-conversions.txt
+ * by default; "-" writes to stderr), one line per conversion site sorted by
+ * decreasing execution count:
+ *   <count> <kind> <file>:<line>:<column> <function> */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/* Layout of the site descriptors emitted by the pass */
+struct taffo_conv_site {
+  const char *file;
+  const char *function;
+  uint32_t line;
+  uint32_t column;
+  uint32_t kind;
+};
+
+struct taffo_conv_table {
+  uint64_t *counters;
+  const struct taffo_conv_site *sites;
+  uint64_t n;
+  struct taffo_conv_table *next;
+};
+
+struct taffo_conv_entry {
+  uint64_t count;
+  const struct taffo_conv_site *site;
+};
+
+
+static struct taffo_conv_table *tables = NULL;
+
+/* Keep in sync with flttofix::ConversionSiteKind */
+static const char *kind_names[] = {
+  "float-to-fix", "fix-to-float", "fix-to-fix", "fallback"
+};
+
+
+static int compare_entries(const void *a, const void *b)
+{
+  const struct taffo_conv_entry *ea = a, *eb = b;
+  if (ea->count != eb->count)
+    return ea->count < eb->count ? 1 : -1;
+  return 0;
+}
+
+
+static void taffo_conv_dump(void)
+{
+  uint64_t total = 0;
+  for (struct taffo_conv_table *t = tables; t; t = t->next)
+    total += t->n;
+
+  struct taffo_conv_entry *entries = malloc(sizeof(struct taffo_conv_entry) * total);
+  if (!entries)
+    return;
+  uint64_t i = 0;
+  for (struct taffo_conv_table *t = tables; t; t = t->next) {
+    for (uint64_t j = 0; j < t->n; j++) {
+      entries[i].count = __atomic_load_n(&t->counters[j], __ATOMIC_RELAXED);
+      entries[i].site = &t->sites[j];
+      i++;
+    }
+  }
+  qsort(entries, total, sizeof(struct taffo_conv_entry), compare_entries);
+
+  const char *filename = getenv("TAFFO_CONVERSION_PROFILE");
+  if (!filename || !*filename)
+    filename = "taffo-conversions.txt";
+  FILE *out = strcmp(filename, "-") == 0 ? stderr : fopen(filename, "w");
+  if (out) {
+    for (i = 0; i < total; i++) {
+      const struct taffo_conv_site *s = entries[i].site;
+      const char *kind = s->kind < sizeof(kind_names) / sizeof(kind_names[0]) ? kind_names[s->kind] : "unknown";
+      fprintf(out, "%llu %s %s:%u:%u %s\n", (unsigned long long)entries[i].count, kind,
+        *s->file ? s->file : "<unknown>", s->line, s->column, s->function);
+    }
+    if (out != stderr)
+      fclose(out);
+  } else {
+    fprintf(stderr, "taffo: cannot write the conversion profile to %s\n", filename);
+  }
+  free(entries);
+}
+
+
+/* Called by the constructor of every instrumented module */
+void __taffo_conv_register(uint64_t *counters, const struct taffo_conv_site *sites, uint64_t n)
+{
+  struct taffo_conv_table *t = malloc(sizeof(struct taffo_conv_table));
+  if (!t)
+    return;
+  t->counters = counters;
+  t->sites = sites;
+  t->n = n;
+  t->next = tables;
+  if (!tables)
+    atexit(taffo_conv_dump);
+  tables = t;
+}
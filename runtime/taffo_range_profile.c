@@ -0,0 +1,79 @@
+/* Runtime of the range profiling instrumentation inserted by the float to
+ * fixed point conversion with -fixp-profile-ranges.
+ *
+ * Every instrumented module registers its table of (minimum, maximum) pairs
+ * at startup. At exit the ranges are written to the file named by the
+ * TAFFO_RANGE_PROFILE environment variable (taffo-ranges.txt by default;
+ * "-" writes to stderr) in the format read by taffo-range-merge:
+ *   module <source file name> <number of values>
+ *   <value id> <minimum> <maximum>
+ * Values never executed are omitted. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+struct taffo_range_table {
+  int64_t (*ranges)[2];
+  uint64_t n;
+  const char *module;
+  struct taffo_range_table *next;
+};
+
+
+static struct taffo_range_table *tables = NULL;
+
+
+/* Inverse of the order preserving mapping of doubles to integers
+ * applied by the instrumentation */
+static double key_to_double(int64_t key)
+{
+  uint64_t bits = (uint64_t)(key < 0 ? key ^ INT64_MAX : key);
+  double res;
+  memcpy(&res, &bits, sizeof(double));
+  return res;
+}
+
+
+static void taffo_range_dump(void)
+{
+  const char *filename = getenv("TAFFO_RANGE_PROFILE");
+  if (!filename || !*filename)
+    filename = "taffo-ranges.txt";
+  FILE *out = strcmp(filename, "-") == 0 ? stderr : fopen(filename, "w");
+  if (!out) {
+    fprintf(stderr, "taffo: cannot write the range profile to %s\n", filename);
+    return;
+  }
+
+  for (struct taffo_range_table *t = tables; t; t = t->next) {
+    fprintf(out, "module %s %llu\n", t->module, (unsigned long long)t->n);
+    for (uint64_t i = 0; i < t->n; i++) {
+      int64_t min = __atomic_load_n(&t->ranges[i][0], __ATOMIC_RELAXED);
+      int64_t max = __atomic_load_n(&t->ranges[i][1], __ATOMIC_RELAXED);
+      if (min > max)
+        continue;
+      fprintf(out, "%llu %.17g %.17g\n", (unsigned long long)i, key_to_double(min), key_to_double(max));
+    }
+  }
+  if (out != stderr)
+    fclose(out);
+}
+
+
+/* Called by the constructor of every instrumented module */
+void __taffo_range_register(int64_t *ranges, uint64_t n, const char *module)
+{
+  struct taffo_range_table *t = malloc(sizeof(struct taffo_range_table));
+  if (!t)
+    return;
+  t->ranges = (int64_t (*)[2])ranges;
+  t->n = n;
+  t->module = module;
+  t->next = tables;
+  if (!tables)
+    atexit(taffo_range_dump);
+  tables = t;
+}
@@ -0,0 +1,136 @@
+/* Checks the removal of the original instructions after the conversion:
+ * the stores, calls and phis which were converted are erased, and then
+ * everything they used which became dead, but nothing which is still used
+ * or which was dead before the conversion. */
+
+#include <string>
+#include <vector>
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "LLVMFloatToFixedPass.h"
+#include "FixpTest.h"
+
+using namespace llvm;
+using namespace flttofix;
+using namespace fixptest;
+
+
+/* %v, %a, %b and the store to %p are the original code of a root %a,
+ * %keep is converted but also used by a call which is not, %acc and %next
+ * are a reduction with root %acc. The *fix values are their conversions. */
+static const char *cleanupModule =
+  "declare void @use(double)\n"
+  "define void @f(double %x, i32 %xfix, double* %q, double* %p, i32* %pfix) {\n"
+  "entry:\n"
+  "  %v = load double, double* %q\n"
+  "  %a = fmul double %v, 2.0\n"
+  "  %b = fadd double %a, 1.0\n"
+  "  store double %b, double* %p\n"
+  "  %unrelated = fadd double %x, 3.0\n"
+  "  %keep = fmul double %x, 4.0\n"
+  "  call void @use(double %keep)\n"
+  "  %afix = shl i32 %xfix, 1\n"
+  "  %bfix = add i32 %afix, 65536\n"
+  "  store i32 %bfix, i32* %pfix\n"
+  "  %keepfix = shl i32 %xfix, 2\n"
+  "  br label %loop\n"
+  "loop:\n"
+  "  %acc = phi double [0.0, %entry], [%next, %loop]\n"
+  "  %accfix = phi i32 [0, %entry], [%nextfix, %loop]\n"
+  "  %next = fadd double %acc, %x\n"
+  "  %nextfix = add i32 %accfix, %xfix\n"
+  "  %cond = icmp slt i32 %nextfix, 1000\n"
+  "  br i1 %cond, label %loop, label %exit\n"
+  "exit:\n"
+  "  ret void\n"
+  "}\n";
+
+
+/* Returns the only store to the given pointer */
+static Instruction *getStoreTo(Function *f, StringRef ptr)
+{
+  for (User *u: getValue(f, ptr)->users()) {
+    if (StoreInst *store = dyn_cast<StoreInst>(u))
+      return store;
+  }
+  return nullptr;
+}
+
+
+static bool exists(Function *f, StringRef name)
+{
+  return f->getValueSymbolTable()->lookup(name) != nullptr;
+}
+
+
+/* Runs the cleanup on the module above; if storeFailed, the conversion of
+ * the original store failed, thus the code of its root must be kept */
+static void checkCleanup(bool storeFailed)
+{
+  std::string testcase = storeFailed ? "cleanup after a failed store" : "cleanup";
+  LLVMContext ctxt;
+  std::unique_ptr<Module> m = parseModule(cleanupModule, ctxt);
+  Function *f = m->getFunction("f");
+  FloatToFixedOptions options;
+  FloatToFixed pass(options);
+
+  Value *a = getValue(f, "a");
+  Value *acc = getValue(f, "acc");
+  Value *keep = getValue(f, "keep");
+  Instruction *store = getStoreTo(f, "p");
+  struct Conversion {
+    Value *orig;
+    Value *conv;
+    Value *root;
+  };
+  std::vector<Conversion> converted = {
+    {a, getValue(f, "afix"), a},
+    {getValue(f, "b"), getValue(f, "bfix"), a},
+    {store, storeFailed ? pass.ConversionError : getStoreTo(f, "pfix"), a},
+    {keep, getValue(f, "keepfix"), keep},
+    {acc, getValue(f, "accfix"), acc},
+    {getValue(f, "next"), getValue(f, "nextfix"), acc}
+  };
+  std::vector<Value *> queue;
+  for (Conversion& c: converted) {
+    std::shared_ptr<ValueInfo> vi = pass.newValueInfo(c.orig);
+    vi->isRoot = c.orig == c.root;
+    vi->roots.insert(c.root);
+    pass.operandPool[c.orig] = c.conv;
+    queue.push_back(c.orig);
+  }
+
+  pass.cleanup(queue);
+
+  /* the reduction does not depend on the store */
+  check(!exists(f, "acc"), "the original phi was not removed", testcase);
+  check(!exists(f, "next"), "the original reduction was not removed", testcase);
+  /* not dead or not part of the conversion */
+  check(exists(f, "keep"), "a value still in use was removed", testcase);
+  check(pass.hasInfo(keep), "the information of a value still in use was dropped", testcase);
+  check(exists(f, "unrelated"), "an instruction not converted was removed", testcase);
+  for (const char *fix: {"afix", "bfix", "keepfix", "accfix", "nextfix", "cond"})
+    check(exists(f, fix), "the converted value %" + Twine(fix) + " was removed", testcase);
+  check(getStoreTo(f, "pfix") != nullptr, "the converted store was removed", testcase);
+
+  if (storeFailed) {
+    check(getStoreTo(f, "p") != nullptr, "the store which was not converted was removed", testcase);
+    check(exists(f, "a") && exists(f, "b") && exists(f, "v"), "the values stored were removed", testcase);
+    check(pass.result.deadInstructions == 1, Twine(pass.result.deadInstructions) + " dead instructions instead of 1",
+      testcase);
+  } else {
+    check(getStoreTo(f, "p") == nullptr, "the original store was not removed", testcase);
+    /* %v is not in the queue, but only the original code used it */
+    check(!exists(f, "b") && !exists(f, "a") && !exists(f, "v"), "the values stored were not removed", testcase);
+    check(pass.result.deadInstructions == 4, Twine(pass.result.deadInstructions) + " dead instructions instead of 4",
+      testcase);
+  }
+}
+
+
+int main()
+{
+  checkCleanup(false);
+  checkCleanup(true);
+  return finish("CleanupTest");
+}
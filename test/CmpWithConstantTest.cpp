@@ -0,0 +1,320 @@
+/* Checks the comparisons between a converted value and a floating point
+ * constant, which are performed in the format of the value: every
+ * predicate with constants which are exact in the format, which are not
+ * and which are out of its range, and the comparisons which fold to a
+ * constant. */
+
+#include <string>
+#include <vector>
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "LLVMFloatToFixedPass.h"
+#include "FixpTest.h"
+
+using namespace llvm;
+using namespace flttofix;
+using namespace fixptest;
+
+
+enum class Expect {
+  /* the comparison is left to convertCmp() */
+  NotHandled,
+  AlwaysTrue,
+  AlwaysFalse,
+  /* "icmp <ipred> %xfix, <k>" */
+  ICmp
+};
+
+
+struct CmpCase {
+  std::string pred;
+  std::string cst;
+  /* the constant is the first operand of the fcmp */
+  bool cstfirst;
+  Expect expect;
+  CmpInst::Predicate ipred;
+  int64_t k;
+};
+
+
+static CmpCase cmp(const std::string& pred, const std::string& cst, CmpInst::Predicate ipred, int64_t k)
+{
+  return {pred, cst, false, Expect::ICmp, ipred, k};
+}
+
+
+static CmpCase cmpFirst(const std::string& pred, const std::string& cst, CmpInst::Predicate ipred, int64_t k)
+{
+  return {pred, cst, true, Expect::ICmp, ipred, k};
+}
+
+
+static CmpCase always(const std::string& pred, const std::string& cst, bool res)
+{
+  return {pred, cst, false, res ? Expect::AlwaysTrue : Expect::AlwaysFalse, CmpInst::BAD_ICMP_PREDICATE, 0};
+}
+
+
+static CmpCase notHandled(const std::string& pred, const std::string& cst)
+{
+  return {pred, cst, false, Expect::NotHandled, CmpInst::BAD_ICMP_PREDICATE, 0};
+}
+
+
+/* Converts the comparison of a value %x, converted to %xfix in format fixpt,
+ * with a double constant */
+static void checkCmp(const FixedPointType& fixpt, const CmpCase& c, bool converted = true)
+{
+  unsigned bits = fixpt.scalarBitsAmt();
+  std::string operands = c.cstfirst ? c.cst + ", %x" : "%x, " + c.cst;
+  std::string testcase = "fcmp " + c.pred + " double " + operands + " in " + fixpt.toString();
+
+  LLVMContext ctxt;
+  std::unique_ptr<Module> m = parseModule(
+    "define i1 @f(double %x, i" + std::to_string(bits) + " %xfix) {\n"
+    "  %c = fcmp " + c.pred + " double " + operands + "\n"
+    "  ret i1 %c\n"
+    "}\n", ctxt);
+  Function *f = m->getFunction("f");
+  Value *x = getValue(f, "x");
+  Value *xfix = getValue(f, "xfix");
+  FCmpInst *fcmp = cast<FCmpInst>(getValue(f, "c"));
+
+  FloatToFixedOptions options;
+  FloatToFixed pass(options);
+  std::shared_ptr<ValueInfo> xinfo = pass.newValueInfo(x);
+  xinfo->fixpType = fixpt;
+  xinfo->origType = x->getType();
+  xinfo->noTypeConversion = !converted;
+  std::shared_ptr<ValueInfo> xfixinfo = pass.newValueInfo(xfix);
+  xfixinfo->fixpType = fixpt;
+  xfixinfo->origType = x->getType();
+  pass.operandPool[x] = xfix;
+
+  Value *res = pass.convertCmpWithConstant(fcmp);
+  ConstantInt *cres = dyn_cast_or_null<ConstantInt>(res);
+  switch (c.expect) {
+    case Expect::NotHandled:
+      check(res == nullptr, "converted, but it is not handled", testcase);
+      break;
+    case Expect::AlwaysTrue:
+      check(cres && cres->isOne(), "not always true", testcase);
+      break;
+    case Expect::AlwaysFalse:
+      check(cres && cres->isZero(), "not always false", testcase);
+      break;
+    case Expect::ICmp: {
+      ICmpInst *icmp = dyn_cast_or_null<ICmpInst>(res);
+      if (!check(icmp != nullptr, "not converted to an icmp", testcase))
+        break;
+      check(icmp->getPredicate() == c.ipred, "icmp " + CmpInst::getPredicateName(icmp->getPredicate()) +
+        " instead of " + CmpInst::getPredicateName(c.ipred), testcase);
+      check(icmp->getOperand(0) == xfix, "the icmp does not use the converted value", testcase);
+      ConstantInt *k = dyn_cast<ConstantInt>(icmp->getOperand(1));
+      if (check(k != nullptr, "the icmp is not with a constant", testcase))
+        check(k->getValue() == APInt(bits, c.k, true), "compared with " + k->getValue().toString(10, true) +
+          " instead of " + Twine(c.k), testcase);
+      break;
+    }
+  }
+}
+
+
+/* Converts two comparisons which are both always true: the constant they
+ * are replaced with is shared, so neither must attach its information to
+ * it */
+static void checkFoldedCmps()
+{
+  std::string testcase = "two comparisons folded to true";
+  LLVMContext ctxt;
+  std::unique_ptr<Module> m = parseModule(
+    "define i1 @f(double %x, i32 %xfix) {\n"
+    "  %c1 = fcmp olt double %x, 40000.0\n"
+    "  %c2 = fcmp one double %x, 0.1\n"
+    "  %c = and i1 %c1, %c2\n"
+    "  ret i1 %c\n"
+    "}\n", ctxt);
+  Function *f = m->getFunction("f");
+  Value *x = getValue(f, "x");
+  Value *xfix = getValue(f, "xfix");
+  FixedPointType s32(true, 16, 32);
+
+  FloatToFixedOptions options;
+  FloatToFixed pass(options);
+  std::shared_ptr<ValueInfo> xinfo = pass.newValueInfo(x);
+  xinfo->fixpType = s32;
+  xinfo->origType = x->getType();
+  std::shared_ptr<ValueInfo> xfixinfo = pass.newValueInfo(xfix);
+  xfixinfo->fixpType = s32;
+  xfixinfo->origType = x->getType();
+  pass.operandPool[x] = xfix;
+  std::vector<Value *> queue;
+  for (const char *name: {"c1", "c2"}) {
+    Value *c = getValue(f, name);
+    std::shared_ptr<ValueInfo> cinfo = pass.newValueInfo(c);
+    cinfo->origType = c->getType();
+    cinfo->noTypeConversion = true;
+    queue.push_back(c);
+  }
+
+  pass.performConversion(*m, queue);
+
+  Constant *t = ConstantInt::getTrue(ctxt);
+  check(pass.operandPool[getValue(f, "c1")] == t, "%c1 not folded to true", testcase);
+  check(pass.operandPool[getValue(f, "c2")] == t, "%c2 not folded to true", testcase);
+  check(!pass.hasInfo(t), "the constant true has the information of a comparison", testcase);
+}
+
+
+int main()
+{
+  /* Q16.16: 1.5 and -2.25 are exact, 0.1 is 6553.6 ulps, the range is
+   * [-32768, 32768) */
+  FixedPointType s32(true, 16, 32);
+  std::vector<CmpCase> signedCases = {
+    cmp("oeq", "1.5", CmpInst::ICMP_EQ, 98304),
+    cmp("one", "1.5", CmpInst::ICMP_NE, 98304),
+    cmp("ogt", "1.5", CmpInst::ICMP_SGT, 98304),
+    cmp("oge", "1.5", CmpInst::ICMP_SGE, 98304),
+    cmp("olt", "1.5", CmpInst::ICMP_SLT, 98304),
+    cmp("ole", "1.5", CmpInst::ICMP_SLE, 98304),
+    cmp("ueq", "1.5", CmpInst::ICMP_EQ, 98304),
+    cmp("une", "1.5", CmpInst::ICMP_NE, 98304),
+    cmp("ugt", "1.5", CmpInst::ICMP_SGT, 98304),
+    cmp("uge", "1.5", CmpInst::ICMP_SGE, 98304),
+    cmp("ult", "1.5", CmpInst::ICMP_SLT, 98304),
+    cmp("ule", "1.5", CmpInst::ICMP_SLE, 98304),
+    cmp("olt", "-2.25", CmpInst::ICMP_SLT, -147456),
+    cmp("oge", "-2.25", CmpInst::ICMP_SGE, -147456),
+    cmp("oeq", "0.0", CmpInst::ICMP_EQ, 0),
+    cmp("oeq", "-0.0", CmpInst::ICMP_EQ, 0),
+    cmp("olt", "-0.0", CmpInst::ICMP_SLT, 0),
+    cmp("oge", "-0.0", CmpInst::ICMP_SGE, 0),
+
+    /* inexact: x < c <=> x <= floor(c), x >= c <=> x > floor(c) */
+    always("oeq", "0.1", false),
+    always("one", "0.1", true),
+    cmp("ogt", "0.1", CmpInst::ICMP_SGT, 6553),
+    cmp("oge", "0.1", CmpInst::ICMP_SGT, 6553),
+    cmp("olt", "0.1", CmpInst::ICMP_SLE, 6553),
+    cmp("ole", "0.1", CmpInst::ICMP_SLE, 6553),
+    always("ueq", "0.1", false),
+    always("une", "0.1", true),
+    cmp("ugt", "0.1", CmpInst::ICMP_SGT, 6553),
+    cmp("uge", "0.1", CmpInst::ICMP_SGT, 6553),
+    cmp("ult", "0.1", CmpInst::ICMP_SLE, 6553),
+    cmp("ule", "0.1", CmpInst::ICMP_SLE, 6553),
+    cmp("olt", "-0.1", CmpInst::ICMP_SLE, -6554),
+    cmp("oge", "-0.1", CmpInst::ICMP_SGT, -6554),
+    cmp("ole", "-0.1", CmpInst::ICMP_SLE, -6554),
+    cmp("ogt", "-0.1", CmpInst::ICMP_SGT, -6554),
+    /* smaller than the resolution of the format */
+    cmp("olt", "1.0e-310", CmpInst::ICMP_SLE, 0),
+    cmp("ogt", "-1.0e-310", CmpInst::ICMP_SGT, -1),
+
+    /* limits of the format */
+    cmp("ole", "0x40DFFFFFFFC00000", CmpInst::ICMP_SLE, 2147483647),
+    cmp("oge", "-32768.0", CmpInst::ICMP_SGE, -2147483648LL),
+    cmp("olt", "-32768.0", CmpInst::ICMP_SLT, -2147483648LL),
+
+    /* out of range above */
+    always("oeq", "32768.0", false),
+    always("one", "32768.0", true),
+    always("olt", "32768.0", true),
+    always("ole", "32768.0", true),
+    always("ogt", "32768.0", false),
+    always("oge", "32768.0", false),
+    always("ult", "40000.0", true),
+    always("uge", "40000.0", false),
+    always("olt", "1.0e300", true),
+    always("olt", "0x7FF0000000000000", true),
+    always("ogt", "0x7FF0000000000000", false),
+
+    /* out of range below */
+    always("oeq", "-40000.0", false),
+    always("one", "-40000.0", true),
+    always("olt", "-40000.0", false),
+    always("ole", "-40000.0", false),
+    always("ogt", "-40000.0", true),
+    always("oge", "-40000.0", true),
+    always("olt", "0xC0E0000000200000", false),
+    always("oge", "0xC0E0000000200000", true),
+    always("ule", "-1.0e300", false),
+    always("olt", "0xFFF0000000000000", false),
+    always("ogt", "0xFFF0000000000000", true),
+
+    /* the constant on the left */
+    cmpFirst("olt", "1.5", CmpInst::ICMP_SGT, 98304),
+    cmpFirst("ole", "1.5", CmpInst::ICMP_SGE, 98304),
+    cmpFirst("oeq", "1.5", CmpInst::ICMP_EQ, 98304),
+    cmpFirst("oge", "0.1", CmpInst::ICMP_SLE, 6553),
+    cmpFirst("ogt", "0.1", CmpInst::ICMP_SLE, 6553),
+    cmpFirst("olt", "0.1", CmpInst::ICMP_SGT, 6553),
+    {"ogt", "40000.0", true, Expect::AlwaysTrue, CmpInst::BAD_ICMP_PREDICATE, 0},
+    {"ogt", "-40000.0", true, Expect::AlwaysFalse, CmpInst::BAD_ICMP_PREDICATE, 0},
+
+    /* left to convertCmp() */
+    notHandled("olt", "0x7FF8000000000000"),
+    notHandled("oeq", "0x7FF8000000000000"),
+    notHandled("ord", "1.5"),
+    notHandled("uno", "1.5"),
+    notHandled("true", "1.5"),
+    notHandled("false", "1.5")
+  };
+  for (const CmpCase& c: signedCases)
+    checkCmp(s32, c);
+
+  /* UQ8.8: the range is [0, 256) */
+  FixedPointType u16(false, 8, 16);
+  std::vector<CmpCase> unsignedCases = {
+    cmp("oeq", "2.0", CmpInst::ICMP_EQ, 512),
+    cmp("one", "2.0", CmpInst::ICMP_NE, 512),
+    cmp("ogt", "2.0", CmpInst::ICMP_UGT, 512),
+    cmp("oge", "2.0", CmpInst::ICMP_UGE, 512),
+    cmp("olt", "2.0", CmpInst::ICMP_ULT, 512),
+    cmp("ole", "2.0", CmpInst::ICMP_ULE, 512),
+    cmp("ugt", "2.0", CmpInst::ICMP_UGT, 512),
+    cmp("ule", "2.0", CmpInst::ICMP_ULE, 512),
+    cmp("ogt", "0.0", CmpInst::ICMP_UGT, 0),
+    cmp("ole", "-0.0", CmpInst::ICMP_ULE, 0),
+    cmp("oeq", "-0.0", CmpInst::ICMP_EQ, 0),
+
+    always("oeq", "0.1", false),
+    always("one", "0.1", true),
+    cmp("ogt", "0.1", CmpInst::ICMP_UGT, 25),
+    cmp("oge", "0.1", CmpInst::ICMP_UGT, 25),
+    cmp("olt", "0.1", CmpInst::ICMP_ULE, 25),
+    cmp("ole", "0.1", CmpInst::ICMP_ULE, 25),
+
+    cmp("ole", "0x406FFFE000000000", CmpInst::ICMP_ULE, 65535),
+    cmp("olt", "0x406FFFE000000000", CmpInst::ICMP_ULT, 65535),
+    always("olt", "256.0", true),
+    always("oge", "256.0", false),
+    always("oeq", "256.0", false),
+
+    /* below zero, even by less than the resolution */
+    always("oeq", "-1.0", false),
+    always("one", "-1.0", true),
+    always("olt", "-1.0", false),
+    always("ole", "-1.0", false),
+    always("ogt", "-1.0", true),
+    always("oge", "-1.0", true),
+    always("olt", "-0.001", false),
+    always("ogt", "-0.001", true),
+    always("ule", "-1.0e-310", false),
+
+    cmpFirst("olt", "2.0", CmpInst::ICMP_UGT, 512),
+    cmpFirst("ugt", "0.1", CmpInst::ICMP_ULE, 25),
+    {"olt", "-1.0", true, Expect::AlwaysTrue, CmpInst::BAD_ICMP_PREDICATE, 0}
+  };
+  for (const CmpCase& c: unsignedCases)
+    checkCmp(u16, c);
+
+  /* only values which have been converted are compared in their format */
+  checkCmp(s32, notHandled("olt", "1.5"), false);
+
+  checkFoldedCmps();
+
+  return finish("CmpWithConstantTest");
+}
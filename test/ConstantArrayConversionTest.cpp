@@ -0,0 +1,146 @@
+/* Checks that the constant float and double arrays converted natively are
+ * the same as when every element is converted with convertAPFloat(), for
+ * the values which the native path converts, for the values which it
+ * leaves to convertAPFloat() and for the arrays converted by several
+ * threads. */
+
+#include <cmath>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+#include "llvm/ADT/APSInt.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/LLVMContext.h"
+#include "LLVMFloatToFixedPass.h"
+#include "FixpTest.h"
+
+using namespace llvm;
+using namespace flttofix;
+using namespace fixptest;
+
+
+/* Returns zeros, values around the limits of the format and of its
+ * resolution, subnormals, infinities and NaN */
+template <class F>
+static std::vector<F> specialValues(FixedPointType fixpt)
+{
+  int frac = fixpt.scalarFracBitsAmt();
+  int intbits = fixpt.scalarBitsAmt() - frac;
+  F ulp = std::ldexp((F)1, -frac);
+  F max = fixpt.scalarIsSigned() ? std::ldexp((F)1, intbits - 1) - ulp : std::ldexp((F)1, intbits) - ulp;
+  F min = fixpt.scalarIsSigned() ? -std::ldexp((F)1, intbits - 1) : (F)0;
+  typedef std::numeric_limits<F> lim;
+
+  return {
+    (F)0, -(F)0,
+    ulp, -ulp, ulp / 2, -ulp / 2, ulp * 3 / 2, -ulp * 3 / 2,
+    (F)1, (F)-1, (F)0.1, (F)-0.1, (F)3.14159265358979, (F)-2.71828182845904,
+    max, min, max + ulp, min - ulp, max + ulp / 2, min - ulp / 2, max * 2, min * 2 - 1,
+    lim::denorm_min(), -lim::denorm_min(), lim::min(), -lim::min(), lim::min() / 3,
+    lim::max(), lim::lowest(), lim::infinity(), -lim::infinity(), lim::quiet_NaN()
+  };
+}
+
+
+/* Returns n values spread over the range of the format and a bit outside
+ * of it, with the special values around the boundaries of the chunks
+ * converted by different threads */
+template <class F>
+static std::vector<F> largeArray(FixedPointType fixpt, size_t n)
+{
+  int frac = fixpt.scalarFracBitsAmt();
+  int intbits = fixpt.scalarBitsAmt() - frac;
+  double hi = std::ldexp(1.0, fixpt.scalarIsSigned() ? intbits - 1 : intbits);
+  double lo = fixpt.scalarIsSigned() ? -hi : -1.0;
+  std::mt19937_64 gen(n);
+  std::uniform_real_distribution<double> dist(lo * 1.25, hi * 1.25);
+
+  std::vector<F> res(n);
+  for (size_t i = 0; i < n; i++)
+    res[i] = (F)dist(gen);
+
+  std::vector<F> special = specialValues<F>(fixpt);
+  const size_t chunksize = 1 << 16;
+  for (size_t c = chunksize; c < n; c += chunksize) {
+    for (size_t j = 0; j < special.size(); j++)
+      res[c - special.size() / 2 + j] = special[j];
+  }
+  for (size_t j = 0; j < special.size(); j++)
+    res[n - 1 - j] = special[j];
+  return res;
+}
+
+
+/* Converts an array with the given number of threads and compares every
+ * element with the result of convertAPFloat().
+ * @returns The converted array */
+static Constant *checkArray(ConstantDataSequential *cds, const FixedPointType& fixpt, unsigned nthreads,
+  const std::string& testcase)
+{
+  FloatToFixedOptions options;
+  options.constantConversionThreads = nthreads;
+  FloatToFixed pass(options);
+
+  Constant *res = pass.convertConstantDataSequential(cds, fixpt);
+  if (!check(res != nullptr, "not converted", testcase))
+    return nullptr;
+
+  unsigned mismatches = 0;
+  for (unsigned i = 0; i < cds->getNumElements(); i++) {
+    APFloat elem = cds->getElementAsAPFloat(i);
+    APSInt expected;
+    pass.convertAPFloat(elem, expected, nullptr, fixpt);
+    const APInt& actual = cast<ConstantInt>(res->getAggregateElement(i))->getValue();
+    if (actual == expected.extOrTrunc(actual.getBitWidth()))
+      continue;
+    /* do not flood the output when a whole array is wrong */
+    if (mismatches++ < 8) {
+      SmallVector<char, 32> elemstr;
+      elem.toString(elemstr);
+      check(false, "element " + Twine(i) + " (" + StringRef(elemstr.data(), elemstr.size()) + ") converted to " +
+        actual.toString(10, fixpt.scalarIsSigned()) + " instead of " + expected.toString(10), testcase);
+    }
+  }
+  return res;
+}
+
+
+int main()
+{
+  LLVMContext ctxt;
+  std::vector<FixedPointType> formats = {
+    FixedPointType(true, 4, 8), FixedPointType(false, 4, 8),
+    FixedPointType(true, 8, 16), FixedPointType(false, 12, 16),
+    FixedPointType(true, 10, 24), FixedPointType(false, 10, 24),
+    FixedPointType(true, 16, 32), FixedPointType(false, 31, 32), FixedPointType(true, 0, 32),
+    FixedPointType(true, 30, 64), FixedPointType(false, 60, 64)
+  };
+
+  for (FixedPointType& fixpt: formats) {
+    std::string fmt = fixpt.toString();
+    std::vector<float> fvals = specialValues<float>(fixpt);
+    std::vector<double> dvals = specialValues<double>(fixpt);
+    checkArray(cast<ConstantDataSequential>(ConstantDataArray::get(ctxt, makeArrayRef(fvals))), fixpt, 1, "float array in " + fmt);
+    checkArray(cast<ConstantDataSequential>(ConstantDataArray::get(ctxt, makeArrayRef(dvals))), fixpt, 1, "double array in " + fmt);
+    checkArray(cast<ConstantDataSequential>(ConstantDataVector::get(ctxt, makeArrayRef(dvals))), fixpt, 1, "double vector in " + fmt);
+  }
+
+  /* more than two chunks, the last one partial */
+  const size_t n = 2 * (1 << 16) + 1234;
+  for (FixedPointType fixpt: {FixedPointType(true, 16, 32), FixedPointType(false, 8, 16), FixedPointType(true, 40, 64)}) {
+    std::string fmt = fixpt.toString();
+    ConstantDataSequential *farr = cast<ConstantDataSequential>(ConstantDataArray::get(ctxt, makeArrayRef(largeArray<float>(fixpt, n))));
+    ConstantDataSequential *darr = cast<ConstantDataSequential>(ConstantDataArray::get(ctxt, makeArrayRef(largeArray<double>(fixpt, n))));
+    for (ConstantDataSequential *arr: {farr, darr}) {
+      std::string testcase = "large " + std::string(arr == farr ? "float" : "double") + " array in " + fmt;
+      Constant *single = checkArray(arr, fixpt, 1, testcase + " with 1 thread");
+      Constant *multi = checkArray(arr, fixpt, 4, testcase + " with 4 threads");
+      checkArray(arr, fixpt, 0, testcase + " with one thread per core");
+      /* constants are uniqued, so equal arrays are the same object */
+      check(single == multi, "different result with 1 and 4 threads", testcase);
+    }
+  }
+
+  return finish("ConstantArrayConversionTest");
+}
@@ -0,0 +1,58 @@
+/* Checks that the library converts a module in a process which has not
+ * run any other pass before, thus where no analysis has been registered
+ * yet. Nothing else may run before the conversion in this test. */
+
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "FloatToFixedConverter.h"
+#include "FixpTest.h"
+
+using namespace llvm;
+using namespace flttofix;
+using namespace fixptest;
+
+
+/* a loop, so that the loop and block frequency analyses have some work to
+ * do; there is no TAFFO metadata, thus nothing to convert */
+static const char *loopModule =
+  "define double @sum(double* %v, i32 %n) {\n"
+  "entry:\n"
+  "  br label %loop\n"
+  "loop:\n"
+  "  %i = phi i32 [0, %entry], [%inext, %loop]\n"
+  "  %acc = phi double [0.0, %entry], [%accnext, %loop]\n"
+  "  %p = getelementptr double, double* %v, i32 %i\n"
+  "  %x = load double, double* %p\n"
+  "  %accnext = fadd double %acc, %x\n"
+  "  %inext = add i32 %i, 1\n"
+  "  %cond = icmp slt i32 %inext, %n\n"
+  "  br i1 %cond, label %loop, label %exit\n"
+  "exit:\n"
+  "  ret double %accnext\n"
+  "}\n";
+
+
+int main()
+{
+  LLVMContext ctxt;
+  std::unique_ptr<Module> m = parseModule(loopModule, ctxt);
+
+  FloatToFixedOptions options;
+  /* use every analysis required by the pass */
+  options.skipColdCode = true;
+  options.profitabilityModel = true;
+  FloatToFixedConverter converter(options);
+  ConversionResult res = converter.convert(*m);
+  check(res.metadataValues == 0, Twine(res.metadataValues) + " values with metadata instead of 0",
+    "conversion without metadata");
+  check(res.queuedValues == 0, Twine(res.queuedValues) + " values converted instead of 0", "conversion without metadata");
+  check(m->getFunction("sum")->getReturnType()->isDoubleTy(), "the function was converted",
+    "conversion without metadata");
+
+  /* a second conversion with the same converter */
+  std::unique_ptr<Module> m2 = parseModule(loopModule, ctxt);
+  res = converter.convert(*m2);
+  check(res.queuedValues == 0, Twine(res.queuedValues) + " values converted instead of 0", "second conversion");
+
+  return finish("ConverterTest");
+}
@@ -0,0 +1,85 @@
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include "llvm/ADT/Twine.h"
+#include "llvm/AsmParser/Parser.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/ValueSymbolTable.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+
+
+#ifndef __FIXP_TEST_H__
+#define __FIXP_TEST_H__
+
+
+/* Helpers shared by the regression tests, which call the members of the
+ * pass directly on small modules written in LLVM assembly */
+namespace fixptest {
+
+
+/** Returns the number of failed checks */
+inline unsigned& failureCount()
+{
+  static unsigned count = 0;
+  return count;
+}
+
+
+/** Reports a failure of the test case if ok is false.
+ *  @returns ok */
+inline bool check(bool ok, const llvm::Twine& what, const llvm::Twine& testcase)
+{
+  if (!ok) {
+    llvm::errs() << "FAIL: " << testcase << ": " << what << "\n";
+    failureCount()++;
+  }
+  return ok;
+}
+
+
+/** Parses a module, terminating the test if the assembly is not valid */
+inline std::unique_ptr<llvm::Module> parseModule(const std::string& ir, llvm::LLVMContext& ctxt)
+{
+  llvm::SMDiagnostic err;
+  std::unique_ptr<llvm::Module> m = llvm::parseAssemblyString(ir, err, ctxt);
+  if (!m) {
+    err.print("test", llvm::errs());
+    std::exit(2);
+  }
+  return m;
+}
+
+
+/** Returns the argument or the instruction of f with the given name,
+ *  terminating the test if there is none */
+inline llvm::Value *getValue(llvm::Function *f, llvm::StringRef name)
+{
+  llvm::Value *v = f->getValueSymbolTable()->lookup(name);
+  if (!v) {
+    llvm::errs() << "no value named " << name << " in " << f->getName() << "\n";
+    std::exit(2);
+  }
+  return v;
+}
+
+
+/** Prints the outcome of the test.
+ *  @returns The exit code of the test program */
+inline int finish(const char *test)
+{
+  if (failureCount() == 0) {
+    llvm::outs() << test << ": all checks passed\n";
+    return 0;
+  }
+  llvm::errs() << test << ": " << failureCount() << " checks failed\n";
+  return 1;
+}
+
+
+}
+
+
+#endif
@@ -0,0 +1,150 @@
+/* Checks that the JIT layer converts and emits only the definitions needed
+ * by the symbols looked up, keeping together the definitions which must be
+ * converted together, and that the local definitions shared by different
+ * parts of a module are emitted once. */
+
+#include <set>
+#include <string>
+#include <vector>
+#include "llvm/ExecutionEngine/Orc/Core.h"
+#include "llvm/ExecutionEngine/Orc/Layer.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/IR/LLVMContext.h"
+#include "FloatToFixedLayer.h"
+#include "FixpTest.h"
+
+using namespace llvm;
+using namespace llvm::orc;
+using namespace flttofix;
+using namespace fixptest;
+
+
+/* @counter and @count are shared by @a and @b, @helper is used only by @a,
+ * @g is a floating point global used by @c and @d, @e2 is an alias of @e */
+static const char *layerModule =
+  "@count = internal global i32 0\n"
+  "@g = global double 1.0\n"
+  "@e2 = alias double (double), double (double)* @e\n"
+  "define internal i32 @counter() {\n"
+  "  %c = load i32, i32* @count\n"
+  "  %n = add i32 %c, 1\n"
+  "  store i32 %n, i32* @count\n"
+  "  ret i32 %n\n"
+  "}\n"
+  "define internal double @helper(double %x) {\n"
+  "  %y = fmul double %x, 2.0\n"
+  "  ret double %y\n"
+  "}\n"
+  "define double @a(double %x) {\n"
+  "  %i = call i32 @counter()\n"
+  "  %y = call double @helper(double %x)\n"
+  "  ret double %y\n"
+  "}\n"
+  "define i32 @b() {\n"
+  "  %i = call i32 @counter()\n"
+  "  ret i32 %i\n"
+  "}\n"
+  "define double @c() {\n"
+  "  %v = load double, double* @g\n"
+  "  ret double %v\n"
+  "}\n"
+  "define void @d(double %x) {\n"
+  "  store double %x, double* @g\n"
+  "  ret void\n"
+  "}\n"
+  "define linkonce_odr double @e(double %x) {\n"
+  "  ret double %x\n"
+  "}\n";
+
+
+/* Records the definitions of the modules emitted through it, and resolves
+ * their symbols to dummy addresses */
+class RecordingLayer : public IRLayer {
+public:
+  std::vector<std::set<std::string>> emitted;
+  std::vector<GlobalValue::LinkageTypes> linkageOfE;
+
+  RecordingLayer(ExecutionSession& es): IRLayer(es) {}
+
+  void emit(MaterializationResponsibility r, ThreadSafeModule tsm) override
+  {
+    std::set<std::string> defs;
+    {
+      ThreadSafeContext::Lock lock = tsm.getContext().getLock();
+      for (GlobalValue& gv: tsm.getModule()->global_values()) {
+        if (gv.isDeclaration())
+          continue;
+        /* the promoted symbols have a unique suffix */
+        std::string name = gv.getName();
+        defs.insert(name.substr(0, name.rfind('.')));
+        if (name == "e")
+          linkageOfE.push_back(gv.getLinkage());
+      }
+    }
+    emitted.push_back(defs);
+
+    SymbolMap addrs;
+    JITTargetAddress next = 0x1000;
+    for (auto& sym: r.getSymbols()) {
+      addrs[sym.first] = JITEvaluatedSymbol(next, sym.second);
+      next += 0x10;
+    }
+    cantFail(r.notifyResolved(addrs));
+    cantFail(r.notifyEmitted());
+  }
+};
+
+
+static void lookup(ExecutionSession& es, JITDylib& jd, RecordingLayer& base, StringRef name,
+  const std::set<std::string>& expected)
+{
+  std::string testcase = "lookup of @" + name.str();
+  size_t before = base.emitted.size();
+  Expected<JITEvaluatedSymbol> sym = es.lookup({&jd}, name);
+  if (!check((bool)sym, "not found", testcase)) {
+    consumeError(sym.takeError());
+    return;
+  }
+  if (!check(base.emitted.size() == before + 1, Twine(base.emitted.size() - before) + " modules emitted instead of 1",
+      testcase))
+    return;
+
+  const std::set<std::string>& actual = base.emitted.back();
+  for (const std::string& def: expected)
+    check(actual.count(def), "@" + def + " was not emitted", testcase);
+  for (const std::string& def: actual)
+    check(expected.count(def), "@" + def + " was emitted too", testcase);
+}
+
+
+int main()
+{
+  ExecutionSession es;
+  JITDylib& jd = es.createJITDylib("main");
+  RecordingLayer base(es);
+  FloatToFixedOptions options;
+  FloatToFixedLayer layer(es, base, options);
+  unsigned conversions = 0;
+  layer.setNotifyConverted([&](Module&, const ConversionResult&) { conversions++; });
+
+  ThreadSafeContext tsctx(std::make_unique<LLVMContext>());
+  std::unique_ptr<Module> m = parseModule(layerModule, *tsctx.getContext());
+  cantFail(layer.add(jd, ThreadSafeModule(std::move(m), tsctx)));
+
+  check(base.emitted.empty() && conversions == 0, "converted before any lookup", "add");
+  /* @counter is promoted, @count stays local to the first part */
+  lookup(es, jd, base, "a", {"a", "helper", "__fixp_promoted.counter", "count"});
+  lookup(es, jd, base, "b", {"b"});
+  lookup(es, jd, base, "c", {"c", "d", "g"});
+  lookup(es, jd, base, "e2", {"e", "e2"});
+  check(conversions == 4, Twine(conversions) + " conversions instead of 4", "partitions");
+  check(base.linkageOfE.size() == 1 && base.linkageOfE[0] == GlobalValue::WeakODRLinkage,
+    "@e could be removed by the conversion", "lookup of @e2");
+
+  /* already emitted with @c */
+  Expected<JITEvaluatedSymbol> d = es.lookup({&jd}, "d");
+  if (!check((bool)d, "not found", "lookup of @d"))
+    consumeError(d.takeError());
+  check(base.emitted.size() == 4, "emitted again", "lookup of @d");
+  return finish("FloatToFixedLayerTest");
+}
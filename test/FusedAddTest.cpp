@@ -0,0 +1,102 @@
+/* Checks the format of the sums generated by the fused multiply-add chains
+ * when the terms differ in signedness: the unsigned term keeps all of its
+ * integer bits besides the sign of the sum, so that adding the largest
+ * values of both formats does not wrap around. */
+
+#include <string>
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "LLVMFloatToFixedPass.h"
+#include "FixpTest.h"
+
+using namespace llvm;
+using namespace flttofix;
+using namespace fixptest;
+
+
+/* %u is an unsigned 15.16, %s a signed 4.16 */
+static const char *addModule =
+  "define void @f(i31 %u, i20 %s) {\n"
+  "  ret void\n"
+  "}\n";
+
+
+struct AddTest {
+  std::string testcase;
+  LLVMContext ctxt;
+  std::unique_ptr<Module> m;
+  FloatToFixedOptions options;
+  FloatToFixed pass;
+  Function *f;
+  Instruction *ip;
+  FixedPointType utype = FixedPointType(false, 16, 31);
+  FixedPointType stype = FixedPointType(true, 16, 20);
+  FixedPointType fixpt = FixedPointType(true, 16, 32);
+  FixedPointType sumtype;
+
+  AddTest(const std::string& testcase): testcase(testcase), pass(options)
+  {
+    m = parseModule(addModule, ctxt);
+    f = m->getFunction("f");
+    ip = f->getEntryBlock().getTerminator();
+  }
+
+  Value *run(Value *u, Value *s, bool sub)
+  {
+    Value *res = pass.genFixedPointWideAdd(u, utype, s, stype, sub, fixpt, ip, sumtype);
+    if (!check(res != nullptr, "not generated", testcase))
+      return nullptr;
+    check(sumtype.scalarIsSigned(), "the sum is unsigned", testcase);
+    check(sumtype.scalarFracBitsAmt() == 16, Twine(sumtype.scalarFracBitsAmt()) + " fractional bits instead of 16",
+      testcase);
+    /* 15 bits of the unsigned term, the sign and the carry */
+    int intbits = sumtype.scalarBitsAmt() - sumtype.scalarFracBitsAmt();
+    check(intbits >= 17, Twine(intbits) + " integer bits instead of 17", testcase);
+    return res;
+  }
+
+  /* Checks that the sum of the constants u and s is exact */
+  void checkConstant(uint64_t u, int64_t s, bool sub)
+  {
+    Value *res = run(ConstantInt::get(Type::getIntNTy(ctxt, 31), u), ConstantInt::getSigned(Type::getIntNTy(ctxt, 20), s),
+      sub);
+    if (!res)
+      return;
+    ConstantInt *cres = dyn_cast<ConstantInt>(res);
+    if (!check(cres != nullptr, "not folded", testcase))
+      return;
+    int64_t expected = sub ? (int64_t)u - s : (int64_t)u + s;
+    check(cres->getSExtValue() == expected, Twine(cres->getSExtValue()) + " instead of " + Twine(expected), testcase);
+  }
+};
+
+
+int main()
+{
+  {
+    AddTest t("mixed-sign add");
+    BinaryOperator *add = dyn_cast_or_null<BinaryOperator>(t.run(getValue(t.f, "u"), getValue(t.f, "s"), false));
+    if (check(add && add->getOpcode() == Instruction::Add, "not an add", t.testcase)) {
+      check(isa<ZExtInst>(add->getOperand(0)), "the unsigned term is not zero-extended", t.testcase);
+      check(isa<SExtInst>(add->getOperand(1)), "the signed term is not sign-extended", t.testcase);
+    }
+  }
+  /* 32767.99998 + 7.99998 */
+  {
+    AddTest t("mixed-sign add of the largest values");
+    t.checkConstant(0x7FFFFFFF, 0x7FFFF, false);
+  }
+  /* 32767.99998 - (-8) */
+  {
+    AddTest t("mixed-sign sub of the largest values");
+    t.checkConstant(0x7FFFFFFF, -0x80000, true);
+  }
+  /* 0 - 7.99998 */
+  {
+    AddTest t("mixed-sign sub with a negative result");
+    t.checkConstant(0, 0x7FFFF, true);
+  }
+
+  return finish("FusedAddTest");
+}
@@ -0,0 +1,236 @@
+/* Checks the rescaling of the length of memcpy, memmove and memset on
+ * converted buffers whose elements change size, and the cases in which the
+ * call cannot be kept as a bulk operation. */
+
+#include <string>
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/LLVMContext.h"
+#include "LLVMFloatToFixedPass.h"
+#include "FixpTest.h"
+
+using namespace llvm;
+using namespace flttofix;
+using namespace fixptest;
+
+
+/* A call to a memory intrinsic on the buffers %dst and %src with elements
+ * of type origt, which may be converted to %dstfix and %srcfix. The call
+ * can use %dst8, %src8 and the length %n. */
+struct MemTest {
+  std::string testcase;
+  LLVMContext ctxt;
+  std::unique_ptr<Module> m;
+  FloatToFixedOptions options;
+  FloatToFixed pass;
+  Function *f;
+  MemIntrinsic *memi = nullptr;
+
+  MemTest(const std::string& testcase, const std::string& origt, const std::string& dstfixt,
+      const std::string& srcfixt, const std::string& call): testcase(testcase), pass(options)
+  {
+    /* i24 is not padded, so that its size is not a divisor or a multiple of
+     * the size of a float */
+    m = parseModule(
+      "target datalayout = \"e-m:e-i24:8-i64:64-f80:128-n8:16:32:64-S128\"\n"
+      "declare void @llvm.memcpy.p0i8.p0i8.i64(i8*, i8*, i64, i1)\n"
+      "declare void @llvm.memmove.p0i8.p0i8.i64(i8*, i8*, i64, i1)\n"
+      "declare void @llvm.memset.p0i8.i64(i8*, i8, i64, i1)\n"
+      "define void @f(" + origt + "* %dst, " + origt + "* %src, " + dstfixt + "* %dstfix, " +
+        srcfixt + "* %srcfix, i64 %n) {\n"
+      "  %dst8 = bitcast " + origt + "* %dst to i8*\n"
+      "  %src8 = bitcast " + origt + "* %src to i8*\n"
+      "  " + call + "\n"
+      "  ret void\n"
+      "}\n", ctxt);
+    f = m->getFunction("f");
+    for (Instruction& i: instructions(f)) {
+      if ((memi = dyn_cast<MemIntrinsic>(&i)))
+        break;
+    }
+  }
+
+  /* Marks %<name> as converted to %<name>fix in the given format */
+  void convert(const std::string& name, const FixedPointType& fixpt)
+  {
+    Value *orig = getValue(f, name);
+    Value *fix = getValue(f, name + "fix");
+    pass.operandPool[orig] = fix;
+    std::shared_ptr<ValueInfo> vi = pass.newValueInfo(fix);
+    vi->fixpType = fixpt;
+    vi->origType = orig->getType();
+  }
+
+  Value *run()
+  {
+    return pass.convertMemIntrinsic(memi);
+  }
+
+  /* Checks that the call was kept on the converted buffers */
+  bool checkRescaled(Value *res, unsigned align)
+  {
+    if (!check(res == memi, "not rescaled", testcase))
+      return false;
+    check(memi->getRawDest()->stripPointerCasts() == getValue(f, "dstfix"), "wrong destination", testcase);
+    check(memi->getDestAlignment() == align, "destination aligned to " + Twine(memi->getDestAlignment()) +
+      " instead of " + Twine(align), testcase);
+    if (MemTransferInst *memt = dyn_cast<MemTransferInst>(memi)) {
+      check(memt->getRawSource()->stripPointerCasts() == getValue(f, "srcfix"), "wrong source", testcase);
+      check(memt->getSourceAlignment() == align, "source aligned to " + Twine(memt->getSourceAlignment()) +
+        " instead of " + Twine(align), testcase);
+    }
+    return true;
+  }
+
+  /* Checks that the length is now the constant len */
+  void checkLength(uint64_t len)
+  {
+    ConstantInt *clen = dyn_cast<ConstantInt>(memi->getLength());
+    if (check(clen != nullptr, "the length is no longer a constant", testcase))
+      check(clen->getZExtValue() == len, "length " + Twine(clen->getZExtValue()) + " instead of " + Twine(len), testcase);
+  }
+
+  /* Checks that the length is now "op len, k" */
+  void checkLength(Instruction::BinaryOps op, Value *len, uint64_t k)
+  {
+    BinaryOperator *binop = dyn_cast<BinaryOperator>(memi->getLength());
+    if (!check(binop && binop->getOpcode() == op, "the length is not a " + Twine(Instruction::getOpcodeName(op)),
+        testcase))
+      return;
+    if (op == Instruction::UDiv)
+      check(binop->isExact(), "the division of the length is not exact", testcase);
+    check(binop->getOperand(0) == len, "the length is not computed from the old one", testcase);
+    ConstantInt *ck = dyn_cast<ConstantInt>(binop->getOperand(1));
+    check(ck && ck->getZExtValue() == k, "the length is not scaled by " + Twine(k), testcase);
+  }
+};
+
+
+int main()
+{
+  FixedPointType q16(true, 16, 32);
+  FixedPointType q8(true, 8, 32);
+  FixedPointType q32l(true, 32, 64);
+  FixedPointType q12(true, 12, 24);
+  const std::string copy = "call void @llvm.memcpy.p0i8.p0i8.i64(i8* align 8 %dst8, i8* align 8 %src8, ";
+  const std::string move = "call void @llvm.memmove.p0i8.p0i8.i64(i8* align 8 %dst8, i8* align 8 %src8, ";
+  const std::string copyf = "call void @llvm.memcpy.p0i8.p0i8.i64(i8* align 4 %dst8, i8* align 4 %src8, ";
+
+  {
+    MemTest t("memcpy of 10 doubles to i32", "double", "i32", "i32", copy + "i64 80, i1 false)");
+    t.convert("dst", q16);
+    t.convert("src", q16);
+    if (t.checkRescaled(t.run(), 4))
+      t.checkLength(40);
+  }
+  {
+    MemTest t("memmove of n bytes of doubles to i32", "double", "i32", "i32", move + "i64 %n, i1 false)");
+    t.convert("dst", q16);
+    t.convert("src", q16);
+    if (t.checkRescaled(t.run(), 4))
+      t.checkLength(Instruction::UDiv, getValue(t.f, "n"), 2);
+  }
+  {
+    MemTest t("memcpy of n bytes of doubles to i64", "double", "i64", "i64", copy + "i64 %n, i1 false)");
+    t.convert("dst", q32l);
+    t.convert("src", q32l);
+    if (t.checkRescaled(t.run(), 8))
+      check(t.memi->getLength() == getValue(t.f, "n"), "the length changed", t.testcase);
+  }
+  {
+    MemTest t("memcpy of 10 floats to i64", "float", "i64", "i64", copyf + "i64 40, i1 false)");
+    t.convert("dst", q32l);
+    t.convert("src", q32l);
+    if (t.checkRescaled(t.run(), 4))
+      t.checkLength(80);
+  }
+  {
+    MemTest t("memmove of n bytes of floats to i64", "float", "i64", "i64",
+      "call void @llvm.memmove.p0i8.p0i8.i64(i8* align 4 %dst8, i8* align 4 %src8, i64 %n, i1 false)");
+    t.convert("dst", q32l);
+    t.convert("src", q32l);
+    if (t.checkRescaled(t.run(), 4))
+      t.checkLength(Instruction::Mul, getValue(t.f, "n"), 2);
+  }
+  {
+    MemTest t("memcpy of 10 floats to i24", "float", "i24", "i24", copyf + "i64 40, i1 false)");
+    t.convert("dst", q12);
+    t.convert("src", q12);
+    if (t.checkRescaled(t.run(), 1))
+      t.checkLength(30);
+  }
+  {
+    MemTest t("memcpy of n bytes of floats to i24", "float", "i24", "i24", copyf + "i64 %n, i1 false)");
+    t.convert("dst", q12);
+    t.convert("src", q12);
+    if (t.checkRescaled(t.run(), 1)) {
+      /* (n / 4) * 3 */
+      BinaryOperator *mul = dyn_cast<BinaryOperator>(t.memi->getLength());
+      BinaryOperator *div = mul ? dyn_cast<BinaryOperator>(mul->getOperand(0)) : nullptr;
+      t.checkLength(Instruction::Mul, div, 3);
+      ConstantInt *k = div ? dyn_cast<ConstantInt>(div->getOperand(1)) : nullptr;
+      check(div && div->getOpcode() == Instruction::UDiv && div->isExact() && div->getOperand(0) == getValue(t.f, "n") &&
+        k && k->getZExtValue() == 4, "the length is not divided by 4", t.testcase);
+    }
+  }
+  {
+    MemTest t("memset to zero of 10 doubles to i32", "double", "i32", "i32",
+      "call void @llvm.memset.p0i8.i64(i8* align 8 %dst8, i8 0, i64 80, i1 false)");
+    t.convert("dst", q16);
+    if (t.checkRescaled(t.run(), 4))
+      t.checkLength(40);
+  }
+  {
+    MemTest t("memset to zero of n bytes of doubles to i32", "double", "i32", "i32",
+      "call void @llvm.memset.p0i8.i64(i8* align 8 %dst8, i8 0, i64 %n, i1 false)");
+    t.convert("dst", q16);
+    if (t.checkRescaled(t.run(), 4))
+      t.checkLength(Instruction::UDiv, getValue(t.f, "n"), 2);
+  }
+
+  /* not expressible as a bulk operation on the converted buffers */
+  {
+    MemTest t("memcpy of a partial double", "double", "i32", "i32", copy + "i64 81, i1 false)");
+    t.convert("dst", q16);
+    t.convert("src", q16);
+    check(t.run() == nullptr, "converted", t.testcase);
+  }
+  {
+    MemTest t("memset to a non-zero value", "double", "i32", "i32",
+      "call void @llvm.memset.p0i8.i64(i8* align 8 %dst8, i8 1, i64 80, i1 false)");
+    t.convert("dst", q16);
+    check(t.run() == nullptr, "converted", t.testcase);
+  }
+  {
+    MemTest t("memcpy between different formats", "double", "i32", "i32", copy + "i64 80, i1 false)");
+    t.convert("dst", q16);
+    t.convert("src", q8);
+    check(t.run() == nullptr, "converted", t.testcase);
+  }
+  {
+    MemTest t("memcpy between different widths", "double", "i32", "i64", copy + "i64 80, i1 false)");
+    t.convert("dst", q16);
+    t.convert("src", q32l);
+    check(t.run() == nullptr, "converted", t.testcase);
+  }
+  {
+    MemTest t("memcpy to a converted buffer from one which is not", "double", "i32", "i32", copy + "i64 80, i1 false)");
+    t.convert("dst", q16);
+    check(t.run() == nullptr, "converted", t.testcase);
+  }
+
+  /* nothing to do */
+  {
+    MemTest t("memcpy between buffers which are not converted", "double", "i32", "i32", copy + "i64 80, i1 false)");
+    check(t.run() == t.pass.Unsupported, "not left to the fallback", t.testcase);
+  }
+  {
+    MemTest t("memset of a buffer which is not converted", "double", "i32", "i32",
+      "call void @llvm.memset.p0i8.i64(i8* align 8 %dst8, i8 1, i64 80, i1 false)");
+    check(t.run() == t.pass.Unsupported, "not left to the fallback", t.testcase);
+  }
+
+  return finish("MemIntrinsicConversionTest");
+}
@@ -0,0 +1,107 @@
+/* Checks the blocks chosen for the conversions of the incoming values of
+ * the phis: the critical edges are split, the values coming from outside
+ * a loop are converted in its preheader, and the loop nest used for the
+ * latter is still right after edges inside the loop have been split. */
+
+#include <string>
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "LLVMFloatToFixedPass.h"
+#include "FixpTest.h"
+
+using namespace llvm;
+using namespace flttofix;
+using namespace fixptest;
+
+
+/* entry -> join0 is critical, loop -> join is critical and inside the loop
+ * whose preheader is join0 */
+static const char *phiModule =
+  "define void @f(double %a, double %b, i1 %c, i32 %n) {\n"
+  "entry:\n"
+  "  br i1 %c, label %then0, label %join0\n"
+  "then0:\n"
+  "  br label %join0\n"
+  "join0:\n"
+  "  %p0 = phi double [%a, %entry], [%b, %then0]\n"
+  "  br label %loop\n"
+  "loop:\n"
+  "  %i = phi i32 [0, %join0], [%inext, %join]\n"
+  "  %y = fmul double %b, 2.0\n"
+  "  %c1 = icmp eq i32 %i, 5\n"
+  "  br i1 %c1, label %then, label %join\n"
+  "then:\n"
+  "  %x = fadd double %b, 1.0\n"
+  "  br label %join\n"
+  "join:\n"
+  "  %q = phi double [%y, %loop], [%b, %then]\n"
+  "  %p = phi double [%a, %loop], [%x, %then]\n"
+  "  %inext = add i32 %i, 1\n"
+  "  %cond = icmp slt i32 %inext, %n\n"
+  "  br i1 %cond, label %loop, label %exit\n"
+  "exit:\n"
+  "  ret void\n"
+  "}\n";
+
+
+static BasicBlock *getBlock(Function *f, StringRef name)
+{
+  return cast<BasicBlock>(f->getValueSymbolTable()->lookup(name));
+}
+
+
+/* Checks that bb was created by splitting the edge from -> to */
+static void checkSplit(BasicBlock *bb, BasicBlock *from, BasicBlock *to, const std::string& testcase)
+{
+  if (!check(bb != nullptr, "no block", testcase))
+    return;
+  check(bb->getSinglePredecessor() == from && bb->getSingleSuccessor() == to,
+    "the block " + bb->getName() + " is not on the split edge " + from->getName() + " -> " + to->getName(), testcase);
+}
+
+
+int main()
+{
+  LLVMContext ctxt;
+  std::unique_ptr<Module> m = parseModule(phiModule, ctxt);
+  Function *f = m->getFunction("f");
+  FloatToFixedOptions options;
+  FloatToFixed pass(options);
+  FixedPointType fixpt(true, 16, 32);
+
+  DominatorTree dt(*f);
+  LoopInfo li(dt);
+  pass.loopNests[f] = FloatToFixed::buildLoopNest(f, li);
+
+  BasicBlock *entry = getBlock(f, "entry");
+  BasicBlock *join0 = getBlock(f, "join0");
+  BasicBlock *loop = getBlock(f, "loop");
+  BasicBlock *then = getBlock(f, "then");
+  BasicBlock *join = getBlock(f, "join");
+  SmallVector<BasicBlock *, 2> res;
+
+  PHINode *p0 = cast<PHINode>(getValue(f, "p0"));
+  pass.getPhiIncomingConversionBlocks(p0, fixpt, res);
+  checkSplit(res[0], entry, join0, "%p0 from %entry");
+  check(p0->getIncomingBlock(0) == res[0], "the phi does not come from the new block", "%p0 from %entry");
+  check(res[1] == getBlock(f, "then0"), "not converted at the end of %then0", "%p0 from %then0");
+
+  /* %y is defined in the loop, %b comes from outside */
+  PHINode *q = cast<PHINode>(getValue(f, "q"));
+  pass.getPhiIncomingConversionBlocks(q, fixpt, res);
+  checkSplit(res[0], loop, join, "%q from %loop");
+  check(res[1] == join0, "not hoisted to the preheader", "%q from %then");
+
+  /* %p now comes from the block split for %q, which is not in the loop
+   * nest, and %a is still hoisted */
+  PHINode *p = cast<PHINode>(getValue(f, "p"));
+  BasicBlock *split = res[0];
+  pass.getPhiIncomingConversionBlocks(p, fixpt, res);
+  check(p->getIncomingBlock(0) == split, "the phi does not come from the split block", "%p from %loop");
+  check(res[0] == join0, "not hoisted to the preheader", "%p from %loop");
+  check(res[1] == then, "not converted at the end of %then", "%p from %then");
+
+  return finish("PhiConversionBlocksTest");
+}
@@ -0,0 +1,69 @@
+/* Checks the reading of the range profiles written by the runtime: only
+ * the entries of the requested module are merged, whatever its name, and
+ * the profiles which do not match the module are rejected. */
+
+#include <map>
+#include <string>
+#include "llvm/Support/Error.h"
+#include "LLVMFloatToFixedPass.h"
+#include "FixpTest.h"
+
+using namespace llvm;
+using namespace flttofix;
+using namespace fixptest;
+
+
+/* The same values of three modules, one with spaces in its name and one
+ * without a name */
+static const char *profile =
+  "module kernel.c 3\n"
+  "0 1 2\n"
+  "2 -5 5\n"
+  "module my kernel.c 3\n"
+  "0 10 20\n"
+  "1 0.5 0.75\n"
+  "module  3\n"
+  "1 -1 1\n"
+  "module kernel.c 3\n"
+  "0 -1 1.5\n";
+
+
+/* Merges the profile above for the given module and compares the result
+ * with the expected ranges */
+static void checkModule(StringRef module, const std::map<size_t, ObservedRange>& expected)
+{
+  std::string testcase = "profile of \"" + module.str() + "\"";
+  std::map<size_t, ObservedRange> ranges;
+  if (Error err = mergeRangeProfile(profile, "test", module, 3, ranges)) {
+    check(false, toString(std::move(err)), testcase);
+    return;
+  }
+  check(ranges == expected, "wrong ranges", testcase);
+}
+
+
+/* Checks that a profile is rejected */
+static void checkRejected(StringRef text, size_t numvals, const std::string& testcase)
+{
+  std::map<size_t, ObservedRange> ranges;
+  Error err = mergeRangeProfile(text, "test", "kernel.c", numvals, ranges);
+  check((bool)err, "not rejected", testcase);
+  consumeError(std::move(err));
+}
+
+
+int main()
+{
+  checkModule("kernel.c", {{0, {-1, 2}}, {2, {-5, 5}}});
+  checkModule("my kernel.c", {{0, {10, 20}}, {1, {0.5, 0.75}}});
+  checkModule("", {{1, {-1, 1}}});
+  checkModule("other.c", {});
+
+  checkRejected("module kernel.c 4\n0 1 2\n", 3, "wrong number of values");
+  checkRejected("module kernel.c 3\n3 1 2\n", 3, "value out of the module");
+  checkRejected("module kernel.c 3\n0 1\n", 3, "line without the maximum");
+  checkRejected("module kernel.c\n0 1 2\n", 3, "module without the number of values");
+  checkRejected("module kernel.c x\n0 1 2\n", 3, "module with a bad number of values");
+
+  return finish("RangeProfileTest");
+}
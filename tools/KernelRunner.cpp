@@ -0,0 +1,193 @@
+#include <chrono>
+#include <limits>
+#include <sstream>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "llvm/IR/Function.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
+#include "KernelRunner.h"
+
+using namespace llvm;
+using namespace llvm::orc;
+using namespace flttofix;
+
+
+KernelRunner::KernelRunner(JITTargetMachineBuilder jtmb, std::unique_ptr<TargetMachine> tm, unsigned optLevel):
+  jtmb(std::move(jtmb)), tm(std::move(tm)), tsctx(std::make_unique<LLVMContext>()), optLevel(optLevel)
+{
+}
+
+
+Expected<std::unique_ptr<KernelRunner>> KernelRunner::create(unsigned optLevel)
+{
+  auto jtmb = JITTargetMachineBuilder::detectHost();
+  if (!jtmb)
+    return jtmb.takeError();
+  auto tm = jtmb->createTargetMachine();
+  if (!tm)
+    return tm.takeError();
+  return std::unique_ptr<KernelRunner>(new KernelRunner(std::move(*jtmb), std::move(*tm), optLevel));
+}
+
+
+void KernelRunner::prepareModule(Module& m)
+{
+  m.setDataLayout(tm->createDataLayout());
+  m.setTargetTriple(tm->getTargetTriple().str());
+}
+
+
+void KernelRunner::optimize(Module& m)
+{
+  PassManagerBuilder pmb;
+  pmb.OptLevel = optLevel;
+  pmb.LibraryInfo = new TargetLibraryInfoImpl(tm->getTargetTriple());
+  tm->adjustPassManager(pmb);
+
+  legacy::FunctionPassManager fpm(&m);
+  legacy::PassManager mpm;
+  fpm.add(createTargetTransformInfoWrapperPass(tm->getTargetIRAnalysis()));
+  mpm.add(createTargetTransformInfoWrapperPass(tm->getTargetIRAnalysis()));
+  pmb.populateFunctionPassManager(fpm);
+  pmb.populateModulePassManager(mpm);
+
+  fpm.doInitialization();
+  for (Function& f: m)
+    fpm.run(f);
+  fpm.doFinalization();
+  mpm.run(m);
+}
+
+
+ConversionResult KernelRunner::convert(Module& m, const FloatToFixedOptions& options)
+{
+  FloatToFixedConverter conv(options, tm->getTargetIRAnalysis());
+  return conv.convert(m);
+}
+
+
+static inline uint64_t readCycleCounter()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+
+static bool hasCycleCounter()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return true;
+#else
+  return false;
+#endif
+}
+
+
+template <class T>
+static void timeKernel(JITTargetAddress addr, const std::vector<double>& inputs, KernelRun& res, uint64_t *counter, unsigned reps)
+{
+  typedef void (*KernelFn)(T *, T *);
+  KernelFn kernel = (KernelFn)addr;
+  std::vector<T> in(inputs.begin(), inputs.end());
+  std::vector<T> out(res.outputs.size());
+
+  /* warm-up execution, also the reference for the outputs */
+  std::vector<T> inwork = in;
+  if (counter)
+    *counter = 0;
+  kernel(inwork.data(), out.data());
+  if (counter)
+    res.counter = *counter;
+  for (size_t i = 0; i < out.size(); i++)
+    res.outputs[i] = out[i];
+
+  res.nanoseconds = std::numeric_limits<double>::infinity();
+  res.cycles = -1.0;
+  for (unsigned r = 0; r < reps; r++) {
+    /* kernels may work in place on their inputs */
+    inwork = in;
+    auto start = std::chrono::steady_clock::now();
+    uint64_t startc = readCycleCounter();
+    kernel(inwork.data(), out.data());
+    uint64_t endc = readCycleCounter();
+    auto end = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    if (ns < res.nanoseconds) {
+      res.nanoseconds = ns;
+      res.cycles = hasCycleCounter() ? (double)(endc - startc) : -1.0;
+    }
+  }
+}
+
+
+Expected<KernelRun> KernelRunner::run(std::unique_ptr<Module> m, StringRef entry,
+  const std::vector<double>& inputs, size_t numOutputs, unsigned reps, StringRef counter)
+{
+  Function *f = m->getFunction(entry);
+  if (!f || f->isDeclaration())
+    return make_error<StringError>("entry point " + entry + " not found", inconvertibleErrorCode());
+  FunctionType *fty = f->getFunctionType();
+  if (fty->getNumParams() != 2 || !fty->getParamType(0)->isPointerTy() || fty->getParamType(0) != fty->getParamType(1))
+    return make_error<StringError>("entry point " + entry + " must have signature void(T *in, T *out)", inconvertibleErrorCode());
+  Type *elemt = fty->getParamType(0)->getPointerElementType();
+  if (!elemt->isFloatTy() && !elemt->isDoubleTy())
+    return make_error<StringError>("entry point " + entry + " must take float or double buffers", inconvertibleErrorCode());
+  bool isdouble = elemt->isDoubleTy();
+
+  auto jit = LLJITBuilder().setJITTargetMachineBuilder(jtmb).create();
+  if (!jit)
+    return jit.takeError();
+  /* kernels may call into the math library */
+  auto procsyms = DynamicLibrarySearchGenerator::GetForCurrentProcess((*jit)->getDataLayout().getGlobalPrefix());
+  if (!procsyms)
+    return procsyms.takeError();
+  (*jit)->getMainJITDylib().addGenerator(std::move(*procsyms));
+
+  if (Error err = (*jit)->addIRModule(ThreadSafeModule(std::move(m), tsctx)))
+    return std::move(err);
+  auto sym = (*jit)->lookup(entry);
+  if (!sym)
+    return sym.takeError();
+
+  uint64_t *counterptr = nullptr;
+  if (!counter.empty()) {
+    auto countersym = (*jit)->lookup(counter);
+    if (!countersym)
+      return countersym.takeError();
+    counterptr = (uint64_t *)countersym->getAddress();
+  }
+
+  KernelRun res;
+  res.outputs.resize(numOutputs);
+  if (isdouble)
+    timeKernel<double>(sym->getAddress(), inputs, res, counterptr, reps);
+  else
+    timeKernel<float>(sym->getAddress(), inputs, res, counterptr, reps);
+  return res;
+}
+
+
+Expected<std::vector<double>> flttofix::readNumbers(StringRef filename)
+{
+  auto buf = MemoryBuffer::getFileOrSTDIN(filename);
+  if (!buf)
+    return errorCodeToError(buf.getError());
+  std::istringstream stream((*buf)->getBuffer().str());
+  std::vector<double> res;
+  double v;
+  while (stream >> v)
+    res.push_back(v);
+  if (!stream.eof())
+    return make_error<StringError>("malformed number in " + filename, inconvertibleErrorCode());
+  return res;
+}
@@ -0,0 +1,83 @@
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "llvm/IR/Module.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "FloatToFixedConverter.h"
+
+
+#ifndef __TAFFO_KERNEL_RUNNER_H__
+#define __TAFFO_KERNEL_RUNNER_H__
+
+
+namespace flttofix {
+
+
+/** Result of the execution of a kernel */
+struct KernelRun {
+  /** Outputs of the last execution */
+  std::vector<double> outputs;
+  /** Fastest execution time, in nanoseconds */
+  double nanoseconds;
+  /** Time stamp counter cycles of the fastest execution, or -1 if the
+   *  host does not have a time stamp counter */
+  double cycles;
+  /** Value of the counter read after the warm-up execution, if any */
+  uint64_t counter = 0;
+};
+
+
+/** Compiles kernels with the ORC JIT for the host and runs them on
+ *  user-provided inputs.
+ *  Kernels are functions with signature
+ *    void entry(T *in, T *out)
+ *  where T is either float or double. The inputs are converted to T before
+ *  the execution, the outputs are converted back to double. */
+class KernelRunner {
+public:
+  static llvm::Expected<std::unique_ptr<KernelRunner>> create(unsigned optLevel);
+
+  /** Context where the modules passed to run() must be created */
+  llvm::LLVMContext& getContext() { return *(tsctx.getContext()); }
+  llvm::TargetMachine& getTargetMachine() { return *tm; }
+
+  /** Sets the data layout and the triple of the host on a module, so that
+   *  the conversion pass can query the target. */
+  void prepareModule(llvm::Module& m);
+  /** Runs the standard optimization pipeline on a module. */
+  void optimize(llvm::Module& m);
+  /** Runs the float to fixed point conversion on a module processed by the
+   *  TAFFO analyses, for the host target. */
+  ConversionResult convert(llvm::Module& m,
+    const FloatToFixedOptions& options = FloatToFixedOptions::fromCommandLine());
+
+  /** Compiles a module and runs its entry point.
+   *  @param reps Number of timed executions after a warm-up execution.
+   *  @param counter If not empty, the name of an i64 global variable of the
+   *    module, which is zeroed before the warm-up execution and read after it. */
+  llvm::Expected<KernelRun> run(std::unique_ptr<llvm::Module> m, llvm::StringRef entry,
+    const std::vector<double>& inputs, size_t numOutputs, unsigned reps,
+    llvm::StringRef counter = "");
+
+private:
+  KernelRunner(llvm::orc::JITTargetMachineBuilder jtmb, std::unique_ptr<llvm::TargetMachine> tm, unsigned optLevel);
+
+  llvm::orc::JITTargetMachineBuilder jtmb;
+  std::unique_ptr<llvm::TargetMachine> tm;
+  llvm::orc::ThreadSafeContext tsctx;
+  unsigned optLevel;
+};
+
+
+/** Reads whitespace-separated numbers from a file. */
+llvm::Expected<std::vector<double>> readNumbers(llvm::StringRef filename);
+
+
+}
+
+
+#endif
@@ -0,0 +1,186 @@
+/* Bit-width auto-tuner for the float to fixed point conversion.
+ *
+ * Converts a kernel with a set of candidate fixed point formats derived from
+ * the ranges in its metadata, runs every variant with the ORC JIT on the
+ * given inputs and reports time and error with respect to the original
+ * floating point kernel, marking the Pareto-optimal variants.
+ *
+ * The input module must have been processed by the TAFFO analyses (it must
+ * contain the range metadata) but not yet converted. */
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include "llvm/IR/Module.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "KernelRunner.h"
+#include "LLVMFloatToFixedPass.h"
+#include "TypeUtils.h"
+#include "Metadata.h"
+
+using namespace llvm;
+using namespace flttofix;
+using namespace mdutils;
+
+
+static cl::opt<std::string> InputFilename(cl::Positional, cl::desc("<input bitcode>"), cl::Required);
+static cl::opt<std::string> EntryName("entry", cl::desc("Kernel entry point, with signature void(T *in, T *out)"), cl::init("kernel"));
+static cl::opt<std::string> InputsFilename("inputs", cl::desc("File with the whitespace-separated inputs of the kernel"), cl::Required);
+static cl::opt<unsigned> NumOutputs("outputs", cl::desc("Number of outputs written by the kernel"), cl::Required);
+static cl::list<unsigned> Widths("widths", cl::desc("Candidate fixed point widths"), cl::CommaSeparated);
+static cl::opt<unsigned> Repetitions("reps", cl::desc("Number of timed executions of each variant"), cl::init(10));
+static cl::opt<unsigned> OptLevel("opt-level", cl::desc("Optimization level applied to all the variants"), cl::init(2));
+static cl::opt<std::string> OutputFilename("o", cl::desc("Output file for the results (CSV)"), cl::init("-"));
+
+
+struct Variant {
+  std::string name;
+  double nanoseconds;
+  double maxError;
+  double meanError;
+  bool pareto = false;
+};
+
+
+/* Assigns to every value with a known range the fixed point type of the
+ * given width which best fits the range */
+static void assignWidth(Module& m, unsigned width)
+{
+  std::lock_guard<std::recursive_mutex> mdlock(getMetadataManagerMutex());
+  MetadataManager& mdmgr = MetadataManager::getMetadataManager();
+
+  auto retype = [&](MDInfo *mdi) -> MDInfo * {
+    InputInfo *ii = dyn_cast_or_null<InputInfo>(mdi);
+    if (!ii || !ii->IRange || !ii->IEnableConversion || !dyn_cast_or_null<FPType>(ii->IType.get()))
+      return nullptr;
+    taffo::FixedPointTypeGenError err;
+    FPType fpt = taffo::fixedPointTypeFromRange(*(ii->IRange), &err, width);
+    if (err == taffo::FixedPointTypeGenError::InvalidRange)
+      return nullptr;
+    InputInfo *newii = cast<InputInfo>(ii->clone());
+    newii->IType.reset(new FPType(fpt));
+    return newii;
+  };
+
+  for (GlobalVariable& gv: m.globals()) {
+    if (MDInfo *newii = retype(mdmgr.retrieveMDInfo(&gv)))
+      mdmgr.setMDInfoMetadata(&gv, newii);
+  }
+  for (Function& f: m) {
+    SmallVector<MDInfo *, 5> argsii;
+    mdmgr.retrieveArgumentInputInfo(f, argsii);
+    bool changed = false;
+    for (MDInfo *& argii: argsii) {
+      if (MDInfo *newii = retype(argii)) {
+        argii = newii;
+        changed = true;
+      }
+    }
+    if (changed)
+      mdmgr.setArgumentInputInfoMetadata(f, argsii);
+
+    for (BasicBlock& bb: f) {
+      for (Instruction& i: bb) {
+        if (MDInfo *newii = retype(mdmgr.retrieveMDInfo(&i)))
+          mdmgr.setMDInfoMetadata(&i, newii);
+      }
+    }
+  }
+}
+
+
+static void markParetoFront(std::vector<Variant>& variants)
+{
+  for (Variant& v: variants) {
+    v.pareto = true;
+    for (Variant& w: variants) {
+      bool dominates = w.nanoseconds <= v.nanoseconds && w.maxError <= v.maxError &&
+        (w.nanoseconds < v.nanoseconds || w.maxError < v.maxError);
+      if (dominates) {
+        v.pareto = false;
+        break;
+      }
+    }
+  }
+}
+
+
+int main(int argc, char *argv[])
+{
+  InitLLVM x(argc, argv);
+  InitializeNativeTarget();
+  InitializeNativeTargetAsmPrinter();
+  cl::ParseCommandLineOptions(argc, argv, "TAFFO fixed point bit-width auto-tuner\n");
+  ExitOnError exitOnErr("taffo-fixp-autotune: ");
+
+  std::vector<double> inputs = exitOnErr(readNumbers(InputsFilename));
+  std::unique_ptr<KernelRunner> runner = exitOnErr(KernelRunner::create(OptLevel));
+
+  SMDiagnostic diag;
+  std::unique_ptr<Module> base = parseIRFile(InputFilename, diag, runner->getContext());
+  if (!base) {
+    diag.print(argv[0], errs());
+    return 1;
+  }
+  runner->prepareModule(*base);
+
+  std::vector<unsigned> widths(Widths.begin(), Widths.end());
+  if (widths.empty())
+    widths = {8, 16, 32, 64};
+
+  std::unique_ptr<Module> reference = CloneModule(*base);
+  runner->optimize(*reference);
+  KernelRun refrun = exitOnErr(runner->run(std::move(reference), EntryName, inputs, NumOutputs, Repetitions));
+
+  std::vector<Variant> variants;
+  variants.push_back({"float", refrun.nanoseconds, 0.0, 0.0});
+
+  for (unsigned width: widths) {
+    std::unique_ptr<Module> m = CloneModule(*base);
+    assignWidth(*m, width);
+    ConversionResult conv = runner->convert(*m);
+    if (conv.conversionErrors)
+      errs() << "fix" << width << ": " << conv.conversionErrors << " values could not be converted\n";
+    runner->optimize(*m);
+
+    Expected<KernelRun> run = runner->run(std::move(m), EntryName, inputs, NumOutputs, Repetitions);
+    if (!run) {
+      errs() << "fix" << width << ": " << toString(run.takeError()) << "\n";
+      continue;
+    }
+    double maxerr = 0.0, sumerr = 0.0;
+    for (size_t i = 0; i < NumOutputs; i++) {
+      double err = std::fabs(run->outputs[i] - refrun.outputs[i]);
+      if (std::isnan(err))
+        err = INFINITY;
+      maxerr = std::max(maxerr, err);
+      sumerr += err;
+    }
+    variants.push_back({"fix" + std::to_string(width), run->nanoseconds, maxerr, NumOutputs ? sumerr / NumOutputs : 0.0});
+  }
+
+  markParetoFront(variants);
+
+  std::error_code ec;
+  ToolOutputFile out(OutputFilename, ec, sys::fs::OF_Text);
+  if (ec) {
+    errs() << "taffo-fixp-autotune: " << ec.message() << "\n";
+    return 1;
+  }
+  out.os() << "variant,time_ns,speedup,max_abs_error,mean_abs_error,pareto\n";
+  for (Variant& v: variants) {
+    out.os() << v.name << "," << v.nanoseconds << "," << refrun.nanoseconds / v.nanoseconds << ","
+      << v.maxError << "," << v.meanError << "," << (v.pareto ? "yes" : "no") << "\n";
+  }
+  out.keep();
+  return 0;
+}
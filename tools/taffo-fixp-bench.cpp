@@ -0,0 +1,180 @@
+/* Differential benchmark for the float to fixed point conversion.
+ *
+ * Runs a kernel before and after the conversion with the ORC JIT on the
+ * given inputs, and reports as JSON the time and the cycles per call of
+ * both versions, the speedup, the error of the converted kernel with
+ * respect to the original one, and the number of conversions between
+ * floating point and integer values executed by each version, together
+ * with the summary of the conversion.
+ *
+ * The input module must have been processed by the TAFFO analyses (it must
+ * contain the range metadata) but not yet converted. */
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include "llvm/IR/Module.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "KernelRunner.h"
+
+using namespace llvm;
+using namespace flttofix;
+
+
+static cl::opt<std::string> InputFilename(cl::Positional, cl::desc("<input bitcode>"), cl::Required);
+static cl::opt<std::string> EntryName("entry", cl::desc("Kernel entry point, with signature void(T *in, T *out)"), cl::init("kernel"));
+static cl::opt<std::string> InputsFilename("inputs", cl::desc("File with the whitespace-separated inputs of the kernel"), cl::Required);
+static cl::opt<unsigned> NumOutputs("outputs", cl::desc("Number of outputs written by the kernel"), cl::Required);
+static cl::opt<unsigned> Repetitions("reps", cl::desc("Number of timed executions of each version"), cl::init(100));
+static cl::opt<unsigned> OptLevel("opt-level", cl::desc("Optimization level applied to both versions"), cl::init(2));
+static cl::opt<std::string> BenchmarkName("name", cl::desc("Name of the benchmark in the report (default: the entry point)"));
+static cl::opt<std::string> OutputFilename("o", cl::desc("Output file for the report (JSON)"), cl::init("-"));
+
+
+static const char *CounterName = "__taffo_bench_conversions";
+
+
+/* Counts every conversion between a floating point and an integer value
+ * executed by the module in an i64 global variable.
+ * The instrumentation is applied after the optimizations, so that the
+ * count reflects the code which is actually timed. */
+static void instrumentConversions(Module& m)
+{
+  Type *i64 = Type::getInt64Ty(m.getContext());
+  GlobalVariable *counter = new GlobalVariable(m, i64, false, GlobalValue::ExternalLinkage,
+    ConstantInt::get(i64, 0), CounterName);
+
+  std::vector<Instruction *> convs;
+  for (Function& f: m) {
+    for (Instruction& i: instructions(f)) {
+      if (isa<FPToSIInst>(i) || isa<FPToUIInst>(i) || isa<SIToFPInst>(i) || isa<UIToFPInst>(i))
+        convs.push_back(&i);
+    }
+  }
+  for (Instruction *i: convs) {
+    IRBuilder<> builder(i);
+    Value *n = ConstantInt::get(i64, i->getType()->isVectorTy() ? i->getType()->getVectorNumElements() : 1);
+    builder.CreateAtomicRMW(AtomicRMWInst::Add, counter, n, AtomicOrdering::Monotonic);
+  }
+}
+
+
+static KernelRun runVersion(KernelRunner& runner, const Module& base, ConversionResult *conv,
+  const std::vector<double>& inputs, ExitOnError& exitOnErr)
+{
+  std::unique_ptr<Module> m = CloneModule(base);
+  if (conv)
+    *conv = runner.convert(*m);
+  runner.optimize(*m);
+
+  std::unique_ptr<Module> counted = CloneModule(*m);
+  instrumentConversions(*counted);
+
+  KernelRun res = exitOnErr(runner.run(std::move(m), EntryName, inputs, NumOutputs, Repetitions));
+  KernelRun countrun = exitOnErr(runner.run(std::move(counted), EntryName, inputs, NumOutputs, 0, CounterName));
+  res.counter = countrun.counter;
+  return res;
+}
+
+
+static json::Object versionToJSON(const KernelRun& run)
+{
+  json::Object res{
+    {"time_ns", run.nanoseconds},
+    {"conversions", (int64_t)run.counter}};
+  if (run.cycles >= 0)
+    res["cycles"] = run.cycles;
+  else
+    res["cycles"] = nullptr;
+  return res;
+}
+
+
+static json::Object conversionToJSON(const ConversionResult& conv)
+{
+  return json::Object{
+    {"queued_values", (int64_t)conv.queuedValues},
+    {"errors", (int64_t)conv.conversionErrors},
+    {"float_to_fix", (int64_t)conv.floatToFixConversions},
+    {"fix_to_float", (int64_t)conv.fixToFloatConversions},
+    {"fallbacks", (int64_t)conv.fallbacks},
+    {"functions_created", (int64_t)conv.functionsCreated}};
+}
+
+
+int main(int argc, char *argv[])
+{
+  InitLLVM x(argc, argv);
+  InitializeNativeTarget();
+  InitializeNativeTargetAsmPrinter();
+  cl::ParseCommandLineOptions(argc, argv, "TAFFO fixed point differential benchmark\n");
+  ExitOnError exitOnErr("taffo-fixp-bench: ");
+
+  std::vector<double> inputs = exitOnErr(readNumbers(InputsFilename));
+  std::unique_ptr<KernelRunner> runner = exitOnErr(KernelRunner::create(OptLevel));
+
+  SMDiagnostic diag;
+  std::unique_ptr<Module> base = parseIRFile(InputFilename, diag, runner->getContext());
+  if (!base) {
+    diag.print(argv[0], errs());
+    return 1;
+  }
+  runner->prepareModule(*base);
+
+  ConversionResult conv;
+  KernelRun fltrun = runVersion(*runner, *base, nullptr, inputs, exitOnErr);
+  KernelRun fixrun = runVersion(*runner, *base, &conv, inputs, exitOnErr);
+
+  double maxerr = 0.0, sumerr = 0.0;
+  for (size_t i = 0; i < NumOutputs; i++) {
+    double err = std::fabs(fixrun.outputs[i] - fltrun.outputs[i]);
+    if (std::isnan(err))
+      err = INFINITY;
+    maxerr = std::max(maxerr, err);
+    sumerr += err;
+  }
+
+  /* JSON has no representation for infinity */
+  auto finiteOrNull = [](double v) -> json::Value {
+    if (std::isfinite(v))
+      return v;
+    return nullptr;
+  };
+
+  json::Object report{
+    {"benchmark", BenchmarkName.empty() ? EntryName.getValue() : BenchmarkName.getValue()},
+    {"entry", EntryName.getValue()},
+    {"target", runner->getTargetMachine().getTargetTriple().str()},
+    {"opt_level", (int64_t)OptLevel},
+    {"repetitions", (int64_t)Repetitions},
+    {"outputs", (int64_t)NumOutputs},
+    {"float", versionToJSON(fltrun)},
+    {"fixed", versionToJSON(fixrun)},
+    {"conversion", conversionToJSON(conv)},
+    {"speedup", finiteOrNull(fltrun.nanoseconds / fixrun.nanoseconds)},
+    {"max_abs_error", finiteOrNull(maxerr)},
+    {"mean_abs_error", finiteOrNull(NumOutputs ? sumerr / NumOutputs : 0.0)}};
+
+  std::error_code ec;
+  ToolOutputFile out(OutputFilename, ec, sys::fs::OF_Text);
+  if (ec) {
+    errs() << "taffo-fixp-bench: " << ec.message() << "\n";
+    return 1;
+  }
+  out.os() << formatv("{0:2}", json::Value(std::move(report))) << "\n";
+  out.keep();
+  return 0;
+}
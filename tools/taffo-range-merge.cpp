@@ -0,0 +1,146 @@
+/* Merges the range profiles recorded by modules instrumented with
+ * -fixp-profile-ranges and writes the observed ranges back into the
+ * metadata of the module.
+ *
+ * The input module must be the one which was instrumented (processed by
+ * the TAFFO analyses, before instrumentation), so that the values are
+ * enumerated in the same order as in the profile. Every profiled value
+ * which was executed gets the observed range, widened by a safety margin
+ * and never wider than its static range; with -retype its fixed point type
+ * is also recomputed from the new range, keeping the same width. */
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+#include "llvm/IR/Module.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "LLVMFloatToFixedPass.h"
+#include "TypeUtils.h"
+#include "Metadata.h"
+
+using namespace llvm;
+using namespace flttofix;
+using namespace mdutils;
+
+
+static cl::opt<std::string> InputFilename(cl::Positional, cl::desc("<input bitcode>"), cl::Required);
+static cl::list<std::string> ProfileFilenames(cl::Positional, cl::desc("<range profiles>"), cl::OneOrMore);
+static cl::opt<double> Margin("margin", cl::desc("Widening of the observed ranges, relative to their width"), cl::init(0.1));
+static cl::opt<bool> Retype("retype", cl::desc("Recompute the fixed point types from the new ranges"), cl::init(true));
+static cl::opt<std::string> OutputFilename("o", cl::desc("Output module"), cl::init("-"));
+static cl::opt<bool> OutputAssembly("S", cl::desc("Write the output module as LLVM assembly"));
+
+
+/* Reads a profile, merging it into the ranges of the given module */
+static Error readProfile(StringRef filename, StringRef module, size_t numvals, std::map<size_t, ObservedRange>& ranges)
+{
+  auto buf = MemoryBuffer::getFileOrSTDIN(filename);
+  if (!buf)
+    return errorCodeToError(buf.getError());
+  return mergeRangeProfile((*buf)->getBuffer(), filename, module, numvals, ranges);
+}
+
+
+/* Returns the metadata of a value with the observed range, or nullptr if
+ * the metadata shall not change */
+static InputInfo *tightenRange(MDInfo *mdi, const ObservedRange& obs)
+{
+  InputInfo *ii = cast<InputInfo>(mdi);
+  const Range& staticr = *(ii->IRange);
+  if (obs.first < staticr.Min || obs.second > staticr.Max) {
+    errs() << "warning: observed range [" << obs.first << ", " << obs.second << "] exceeds the static range ["
+      << staticr.Min << ", " << staticr.Max << "]; keeping the static range\n";
+    return nullptr;
+  }
+
+  double margin = (obs.second - obs.first) * Margin;
+  if (margin == 0.0)
+    /* the value is a constant in the profile; still allow some rounding */
+    margin = std::max(std::fabs(obs.first) * Margin, std::numeric_limits<double>::min());
+  double min = std::max(staticr.Min, obs.first - margin);
+  double max = std::min(staticr.Max, obs.second + margin);
+
+  InputInfo *newii = cast<InputInfo>(ii->clone());
+  newii->IRange.reset(new Range(min, max));
+  if (Retype) {
+    if (FPType *oldt = dyn_cast_or_null<FPType>(ii->IType.get())) {
+      taffo::FixedPointTypeGenError err;
+      FPType fpt = taffo::fixedPointTypeFromRange(*(newii->IRange), &err, oldt->getWidth());
+      if (err != taffo::FixedPointTypeGenError::InvalidRange)
+        newii->IType.reset(new FPType(fpt));
+    }
+  }
+  return newii;
+}
+
+
+int main(int argc, char *argv[])
+{
+  InitLLVM x(argc, argv);
+  cl::ParseCommandLineOptions(argc, argv, "TAFFO range profile merger\n");
+  ExitOnError exitOnErr("taffo-range-merge: ");
+
+  LLVMContext ctxt;
+  SMDiagnostic diag;
+  std::unique_ptr<Module> m = parseIRFile(InputFilename, diag, ctxt);
+  if (!m) {
+    diag.print(argv[0], errs());
+    return 1;
+  }
+
+  std::vector<Value *> vals;
+  collectProfiledValues(*m, vals);
+  std::map<size_t, ObservedRange> ranges;
+  for (std::string& filename: ProfileFilenames)
+    exitOnErr(readProfile(filename, m->getSourceFileName(), vals.size(), ranges));
+
+  std::lock_guard<std::recursive_mutex> mdlock(getMetadataManagerMutex());
+  MetadataManager& mdmgr = MetadataManager::getMetadataManager();
+  unsigned tightened = 0;
+  for (auto& r: ranges) {
+    Value *v = vals[r.first];
+    if (Instruction *i = dyn_cast<Instruction>(v)) {
+      if (InputInfo *newii = tightenRange(mdmgr.retrieveMDInfo(i), r.second)) {
+        mdmgr.setMDInfoMetadata(i, newii);
+        tightened++;
+      }
+    } else {
+      Argument *arg = cast<Argument>(v);
+      Function *f = arg->getParent();
+      SmallVector<MDInfo *, 5> argsii;
+      mdmgr.retrieveArgumentInputInfo(*f, argsii);
+      if (InputInfo *newii = tightenRange(argsii[arg->getArgNo()], r.second)) {
+        argsii[arg->getArgNo()] = newii;
+        mdmgr.setArgumentInputInfoMetadata(*f, argsii);
+        tightened++;
+      }
+    }
+  }
+  errs() << "taffo-range-merge: tightened the range of " << tightened << " of " << vals.size() << " values ("
+    << ranges.size() << " executed)\n";
+
+  std::error_code ec;
+  ToolOutputFile out(OutputFilename, ec, OutputAssembly ? sys::fs::OF_Text : sys::fs::OF_None);
+  if (ec) {
+    errs() << "taffo-range-merge: " << ec.message() << "\n";
+    return 1;
+  }
+  if (OutputAssembly)
+    m->print(out.os(), nullptr);
+  else
+    WriteBitcodeToFile(*m, out.os());
+  out.keep();
+  return 0;
+}